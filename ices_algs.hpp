@@ -12,21 +12,41 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <optional>
+#include <vector>
 
+#include "ices_count.hpp"
+#include "ices_fixed.hpp"
+#include "ices_stats.hpp"
 #include "ices_types.hpp"
 
 namespace ices {
 // Solve the iceberg avoiding problem for the given grid, using an exhaustive
 // optimization algorithm.
 //
+// Every path from (0, 0) to (rows-1, columns-1) takes exactly rows-1 down
+// steps and columns-1 right steps, so the candidates are the bit strings of
+// length rows+columns-2 with exactly rows-1 one (down) bits; no other bit
+// string can reach the goal. Step t is bit (steps-1-t), so the first step
+// is the most significant bit.
+//
 // This algorithm is expected to run in exponential time, so the grid's
 // width+height must be small enough to fit in a 64-bit int; this is enforced
 // with an assertion.
 //
+// Counts are accumulated with the given count policy (see ices_count.hpp),
+// and what the search did is recorded in stats (see ices_stats.hpp).
+//
 // The grid must be non-empty.
-unsigned int iceberg_avoiding_exhaustive(const grid& setting) {
+template <typename Policy, typename Stats>
+typename Policy::value_type iceberg_avoiding_exhaustive(const grid& setting,
+                                                        const Policy& policy,
+                                                        Stats& stats) {
 
   // grid must be non-empty.
   assert(setting.rows() > 0);
@@ -36,94 +56,487 @@ unsigned int iceberg_avoiding_exhaustive(const grid& setting) {
   const size_t steps = setting.rows() + setting.columns() - 2;
   assert(steps < 64);
 
-  unsigned int count_paths = 0;
+  // The first candidate takes all of its down steps last.
+  auto phase = stats.phase(PHASE_SOLVE);
+  typename Policy::value_type count_paths = policy.zero();
+  exhaustive_count_range(setting,
+                         (std::uint64_t(1) << (setting.rows() - 1)) - 1,
+                         std::uint64_t(1) << steps,
+                         count_paths, policy, stats);
+  return count_paths;
+}
 
-  for(unsigned bits = 0; bits <= (pow(2, steps)-1); bits++)
-  {
-    //initialize candidate path
-    path candidatePath(setting);
-
-    //loop through grid
-    for(unsigned k = 0; k <= steps-1; k++)
-    {
-      unsigned bit = (bits>>k)&1;
-
-      if(bit == 1) // columns
-      {
-        if(candidatePath.is_step_valid(STEP_DIRECTION_RIGHT))
-        { //go right if valid
-          candidatePath.add_step(STEP_DIRECTION_RIGHT);
-        }
-      }else // rows
-      {
-        if(candidatePath.is_step_valid(STEP_DIRECTION_DOWN))
-        { // go down if valid
-          candidatePath.add_step(STEP_DIRECTION_DOWN);
+// Exhaustive search without stats. Common shapes are solved by the
+// fixed-shape search of ices_fixed.hpp.
+template <typename Policy>
+typename Policy::value_type iceberg_avoiding_exhaustive(const grid& setting,
+                                                        const Policy& policy) {
+  auto fixed = try_common_fixed_shapes<Policy>(setting, [&](const auto& g) {
+    return iceberg_avoiding_exhaustive(g, policy);
+  });
+  if (fixed) {
+    return *fixed;
+  }
+  null_stats stats;
+  return iceberg_avoiding_exhaustive(setting, policy, stats);
+}
+
+// Solve the iceberg avoiding problem exhaustively with unsigned int counts
+// that wrap on overflow.
+unsigned int iceberg_avoiding_exhaustive(const grid& setting) {
+  return iceberg_avoiding_exhaustive(setting, wrapping_count());
+}
+
+// Solve the iceberg avoiding problem exhaustively, returning the stats
+// recorded along the way with the solution.
+template <typename Policy>
+solution_with_stats<typename Policy::value_type>
+iceberg_avoiding_exhaustive_with_stats(const grid& setting,
+                                       const Policy& policy) {
+  recording_stats stats;
+  auto count = iceberg_avoiding_exhaustive(setting, policy, stats);
+  return {std::move(count), stats.stats()};
+}
+
+// Turn every water cell of the given grid that cannot reach
+// (rows-1, columns-1) by right and down steps into an iceberg, in place.
+// Returns false if (0, 0) itself cannot reach the goal, so there is no
+// path; the grid is then left partly updated.
+bool remove_dead_ends(grid& live) {
+
+  const coordinate rows = live.rows(), columns = live.columns();
+
+  for (coordinate i = rows; i-- > 0; ) {
+    for (coordinate j = columns; j-- > 0; ) {
+      bool is_goal = (i == rows - 1) && (j == columns - 1);
+      if (live.may_step(i, j) && !is_goal &&
+          !live.may_step(i + 1, j) && !live.may_step(i, j + 1)) {
+        if ((i == 0) && (j == 0)) {
+          return false;
         }
+        live.set(i, j, CELL_ICEBERG);
       }
     }
+  }
+  return live.may_step(rows - 1, columns - 1);
+}
+
+// Return a copy of the given grid in which every water cell that cannot
+// reach (rows-1, columns-1) by right and down steps is turned into an
+// iceberg. If (0, 0) itself cannot reach the goal, there is no path, and
+// std::nullopt is returned instead.
+std::optional<grid> without_dead_ends(const grid& setting) {
+  grid live = setting;
+  if (!remove_dead_ends(live)) {
+    return std::nullopt;
+  }
+  return live;
+}
+
+// Count the paths that extend candidate, which must be an empty path, to
+// the bottom-right cell of its grid, adding them to count_paths. This is
+// the search loop of iceberg_avoiding_backtracking.
+template <typename Policy, typename Stats>
+void backtracking_count(path& candidate,
+                        typename Policy::value_type& count_paths,
+                        const Policy& policy,
+                        Stats& stats) {
+
+  assert(candidate.steps().size() == 1);
 
-    // if candidate stays inside the grid and never crosses an X cell:
-    if(candidatePath.final_row() == setting.rows()-1 &&
-    candidatePath.final_column() == setting.columns()-1)
-    { // increment total number of paths
-      count_paths++;
+  const coordinate goal_row = candidate.setting().rows() - 1,
+    goal_column = candidate.setting().columns() - 1;
+
+  // Depth-first search; the path itself is the stack. When descending,
+  // extend the path right if possible, otherwise down. When backtracking,
+  // pop a step, and if it was a right step, try down from the same cell.
+  bool descending = true;
+  while (true) {
+    if (descending) {
+      if ((candidate.final_row() == goal_row) &&
+          (candidate.final_column() == goal_column)) {
+        policy.add_to(count_paths, policy.one());
+        descending = false;
+      } else if (candidate.is_step_valid(STEP_DIRECTION_RIGHT)) {
+        candidate.add_step(STEP_DIRECTION_RIGHT);
+        stats.add_candidates(1);
+      } else if (candidate.is_step_valid(STEP_DIRECTION_DOWN)) {
+        candidate.add_step(STEP_DIRECTION_DOWN);
+        stats.add_candidates(1);
+      } else {
+        stats.add_pruned(1);
+        descending = false;
+      }
+    } else {
+      if (candidate.steps().size() == 1) {
+        break;
+      }
+      step_direction last = candidate.last_step().direction();
+      candidate.remove_last_step();
+      if ((last == STEP_DIRECTION_RIGHT) &&
+          candidate.is_step_valid(STEP_DIRECTION_DOWN)) {
+        candidate.add_step(STEP_DIRECTION_DOWN);
+        stats.add_candidates(1);
+        descending = true;
+      }
     }
   }
+}
+
+// Solve the iceberg avoiding problem for the given grid, using a
+// backtracking exhaustive search.
+//
+// Paths are built one step at a time, trying right before down, and a
+// prefix is abandoned as soon as its next step would leave the grid or hit
+// an iceberg. When prune_dead_ends is true, cells from which the goal is
+// unreachable are treated as icebergs too (see without_dead_ends), so every
+// prefix explored extends to at least one path. Every path is still found
+// and counted one at a time, so this remains independent of the dynamic
+// programming recurrence.
+//
+// There is no limit on the path length, but the running time is
+// proportional to the number of prefixes explored.
+//
+// Counts are accumulated with the given count policy (see ices_count.hpp),
+// and what the search did is recorded in stats (see ices_stats.hpp): each
+// prefix explored is a candidate, and each one that cannot be extended is
+// pruned.
+//
+// The grid must be non-empty.
+template <typename Policy, typename Stats>
+typename Policy::value_type
+iceberg_avoiding_backtracking(const grid& setting,
+                              const Policy& policy,
+                              bool prune_dead_ends,
+                              Stats& stats) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  typename Policy::value_type count_paths = policy.zero();
+
+  std::optional<grid> live;
+  if (prune_dead_ends) {
+    auto phase = stats.phase(PHASE_PREPARE);
+    live = without_dead_ends(setting);
+    stats.add_cells(setting.rows() * setting.columns());
+    stats.add_bytes(setting.words().size() * sizeof(grid::word));
+    if (!live) {
+      return count_paths;
+    }
+  }
+
+  auto phase = stats.phase(PHASE_SOLVE);
+  path candidate(live ? *live : setting);
+  backtracking_count(candidate, count_paths, policy, stats);
+  stats.add_bytes(candidate.steps().capacity() * sizeof(step));
   return count_paths;
 }
 
+// Backtracking search without stats.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_backtracking(const grid& setting,
+                              const Policy& policy,
+                              bool prune_dead_ends) {
+  null_stats stats;
+  return iceberg_avoiding_backtracking(setting, policy, prune_dead_ends,
+                                       stats);
+}
+
+// Backtracking exhaustive search with unsigned int counts that wrap on
+// overflow.
+unsigned int iceberg_avoiding_backtracking(const grid& setting,
+                                           bool prune_dead_ends = true) {
+  return iceberg_avoiding_backtracking(setting, wrapping_count(),
+                                       prune_dead_ends);
+}
+
+// Solve the iceberg avoiding problem by backtracking, returning the stats
+// recorded along the way with the solution.
+template <typename Policy>
+solution_with_stats<typename Policy::value_type>
+iceberg_avoiding_backtracking_with_stats(const grid& setting,
+                                         const Policy& policy,
+                                         bool prune_dead_ends = true) {
+  recording_stats stats;
+  auto count = iceberg_avoiding_backtracking(setting, policy, prune_dead_ends,
+                                             stats);
+  return {std::move(count), stats.stats()};
+}
+
+// A table holding one count per cell of a grid, stored contiguously in
+// row-major order.
+template <typename Count>
+class count_table {
+private:
+  coordinate rows_, columns_;
+  std::vector<Count> cells_;
+
+public:
+
+  // Create a table with the given number of rows and columns, all
+  // initialized to zero.
+  count_table(coordinate rows, coordinate columns)
+  : rows_(rows), columns_(columns), cells_(rows * columns, Count()) {
+
+    assert(rows > 0);
+    assert(columns > 0);
+  }
+
+  // Accessors.
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+
+  // Return the count at the given row and column.
+  const Count& get(coordinate row, coordinate column) const {
+    assert((row < rows_) && (column < columns_));
+    return cells_[row * columns_ + column];
+  }
+  Count& get(coordinate row, coordinate column) {
+    assert((row < rows_) && (column < columns_));
+    return cells_[row * columns_ + column];
+  }
+
+  // Return a pointer to the columns() counts of the given row.
+  const Count* row(coordinate row) const {
+    assert(row < rows_);
+    return cells_.data() + row * columns_;
+  }
+  Count* row(coordinate row) {
+    assert(row < rows_);
+    return cells_.data() + row * columns_;
+  }
+};
+
+// Advance columns [begin, end) of one row of the dynamic programming
+// algorithm in place.
+//
+// On entry, counts[j] holds the number of paths reaching column j of the
+// row above, and from_left the number of paths reaching column begin - 1 of
+// this row (zero when begin is 0). On exit counts[j] holds the number of
+// paths reaching column j of this row. ice points to the packed words of
+// this row, as returned by grid::row_words.
+//
+// Cells are consumed one packed word at a time, so a word with no icebergs
+// runs a plain prefix-sum loop with no per-cell tests.
+template <typename Policy>
+void dyn_prog_row_segment(const grid::word* ice,
+                          typename Policy::value_type* counts,
+                          coordinate begin,
+                          coordinate end,
+                          const typename Policy::value_type& from_left,
+                          const Policy& policy) {
+
+  assert(begin < end);
+
+  if ((ice[begin / grid::WORD_BITS] >> (begin % grid::WORD_BITS)) & 1) {
+    counts[begin] = policy.zero();
+  } else {
+    policy.add_to(counts[begin], from_left);
+  }
+  for (coordinate j = begin + 1; j < end; ) {
+    grid::word w = ice[j / grid::WORD_BITS] >> (j % grid::WORD_BITS);
+    coordinate word_end = std::min(end,
+                                   (j / grid::WORD_BITS + 1) * grid::WORD_BITS);
+    if (w == 0) {
+      for (; j < word_end; ++j) {
+        policy.add_to(counts[j], counts[j - 1]);
+      }
+    } else {
+      for (; j < word_end; ++j, w >>= 1) {
+        if (w & 1) {
+          counts[j] = policy.zero();
+        } else {
+          policy.add_to(counts[j], counts[j - 1]);
+        }
+      }
+    }
+  }
+}
+
+// Advance one whole row of the dynamic programming algorithm in place.
+//
+// On entry, counts holds the number of paths reaching each cell of the row
+// above (for the first row, a 1 above (0, 0) and 0 elsewhere). On exit it
+// holds the number of paths reaching each cell of this row.
+template <typename Policy>
+void dyn_prog_row(const grid::word* ice,
+                  typename Policy::value_type* counts,
+                  coordinate columns,
+                  const Policy& policy) {
+  dyn_prog_row_segment(ice, counts, 0, columns, policy.zero(), policy);
+}
+
+// Advance one whole row of the backward dynamic programming recurrence of
+// iceberg_avoiding_backward_table in place.
+//
+// On entry, counts holds the number of paths from each cell of the row
+// below to (rows-1, columns-1) (for the last row, a 1 below the
+// bottom-right cell and 0 elsewhere). On exit it holds the number of paths
+// from each cell of this row. ice points to the packed words of this row.
+template <typename Policy>
+void backward_row(const grid::word* ice,
+                  typename Policy::value_type* counts,
+                  coordinate columns,
+                  const Policy& policy) {
+  for (coordinate j = columns; j-- > 0; ) {
+    if ((ice[j / grid::WORD_BITS] >> (j % grid::WORD_BITS)) & 1) {
+      counts[j] = policy.zero();
+    } else if (j + 1 < columns) {
+      policy.add_to(counts[j], counts[j + 1]);
+    }
+  }
+}
+
+// Run the rolling-row dynamic programming algorithm on any grid type that
+// provides rows(), columns() and row_words() with the packed layout of
+// grid, such as grid itself or mapped_grid (see ices_io.hpp), recording
+// what it did in stats (see ices_stats.hpp).
+template <typename PackedGrid, typename Policy, typename Stats>
+typename Policy::value_type dyn_prog_rolling(const PackedGrid& setting,
+                                             const Policy& policy,
+                                             Stats& stats) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  // counts starts as the row "above" row 0, with a single path entering
+  // (0, 0); every later row is computed in place from the previous one.
+  std::vector<typename Policy::value_type> counts;
+  {
+    auto phase = stats.phase(PHASE_PREPARE);
+    counts.assign(setting.columns(), policy.zero());
+    counts[0] = policy.one(); // base case
+    stats.add_bytes(counts.size() * sizeof(typename Policy::value_type));
+  }
+
+  auto phase = stats.phase(PHASE_SOLVE);
+  for (coordinate i = 0; i < setting.rows(); ++i) {
+    dyn_prog_row(setting.row_words(i), counts.data(), setting.columns(),
+                 policy);
+  }
+  stats.add_cells(setting.rows() * setting.columns());
+  return counts.back();
+}
+
+// dyn_prog_rolling without stats.
+template <typename PackedGrid, typename Policy>
+typename Policy::value_type dyn_prog_rolling(const PackedGrid& setting,
+                                             const Policy& policy) {
+  null_stats stats;
+  return dyn_prog_rolling(setting, policy, stats);
+}
+
 // Solve the iceberg avoiding problem for the given grid, using a dynamic
 // programming algorithm.
 //
+// Only one row of counts is kept, so memory is O(columns) regardless of the
+// number of rows. Use iceberg_avoiding_dyn_prog_table when the per-cell
+// counts are needed. Counts are accumulated with the given count policy
+// (see ices_count.hpp). Common shapes are solved by the fixed-shape
+// dynamic programming of ices_fixed.hpp, which needs no heap allocation.
+//
 // The grid must be non-empty.
+template <typename Policy>
+typename Policy::value_type iceberg_avoiding_dyn_prog(const grid& setting,
+                                                      const Policy& policy) {
+  auto fixed = try_common_fixed_shapes<Policy>(setting, [&](const auto& g) {
+    return iceberg_avoiding_dyn_prog(g, policy);
+  });
+  if (fixed) {
+    return *fixed;
+  }
+  return dyn_prog_rolling(setting, policy);
+}
+
+// Solve the iceberg avoiding problem by dynamic programming with unsigned
+// int counts that wrap on overflow.
 unsigned int iceberg_avoiding_dyn_prog(const grid& setting) {
+  return iceberg_avoiding_dyn_prog(setting, wrapping_count());
+}
+
+// Solve the iceberg avoiding problem by dynamic programming, returning the
+// stats recorded along the way with the solution.
+template <typename Policy>
+solution_with_stats<typename Policy::value_type>
+iceberg_avoiding_dyn_prog_with_stats(const grid& setting,
+                                     const Policy& policy) {
+  recording_stats stats;
+  auto count = dyn_prog_rolling(setting, policy, stats);
+  return {std::move(count), stats.stats()};
+}
+
+// Solve the iceberg avoiding problem for the given grid, using the same
+// dynamic programming algorithm as iceberg_avoiding_dyn_prog, but keeping
+// the whole table. Entry (i, j) of the result is the number of paths from
+// (0, 0) to (i, j); the bottom-right entry is the solution.
+//
+// This takes O(rows * columns) memory.
+//
+// The grid must be non-empty.
+template <typename Policy>
+count_table<typename Policy::value_type>
+iceberg_avoiding_dyn_prog_table(const grid& setting, const Policy& policy) {
 
   // grid must be non-empty.
   assert(setting.rows() > 0);
   assert(setting.columns() > 0);
 
+  count_table<typename Policy::value_type> A(setting.rows(),
+                                             setting.columns());
+
+  // The first row is computed from a virtual row holding the base case;
+  // each later row starts as a copy of the row above.
+  A.get(0, 0) = policy.one(); // base case
+  dyn_prog_row(setting.row_words(0), A.row(0), setting.columns(), policy);
+  for (coordinate i = 1; i < setting.rows(); ++i) {
+    std::copy(A.row(i - 1), A.row(i - 1) + setting.columns(), A.row(i));
+    dyn_prog_row(setting.row_words(i), A.row(i), setting.columns(), policy);
+  }
+  return A;
+}
 
-  const int DIM=100;
-  std::vector<std::vector<unsigned>> A(DIM, std::vector<unsigned>(DIM));
+// Compute the table of paths from each cell to (rows-1, columns-1), the
+// mirror image of iceberg_avoiding_dyn_prog_table: entry (i, j) is the
+// number of paths from (i, j) to the bottom-right cell, so the top-left
+// entry is the solution.
+//
+// This takes O(rows * columns) memory; checkpointed_count_table in
+// ices_chokepoints.hpp answers the same per-cell queries in
+// O(sqrt(rows) * columns).
+//
+// The grid must be non-empty.
+template <typename Policy>
+count_table<typename Policy::value_type>
+iceberg_avoiding_backward_table(const grid& setting, const Policy& policy) {
 
-  A[0][0] = 1; // base case
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
 
-  //loop through rows
-  for(unsigned i = 0; i <= (setting.rows()-1); i++)
-  {
-    //loop through columns
-    for(unsigned j = 0; j <= (setting.columns()-1); j++)
-    {
-      //variables to hold number of paths
-      //coming in from above and left
-      unsigned from_above = 0;
-      unsigned from_left = 0;
-
-      //setting values of variables to hold number
-      //of paths coming in from above and left
-      //after the starting cell
-      if (i > 0)
-      {
-        from_above = A[i-1][j];
-      }
-      if (j > 0)
-      {
-        from_left = A[i][j-1];
-      }
-      //adding together number of paths from
-      //both directions into the current cell
-      A[i][j] += from_above + from_left;
-
-      //if current cell is an iceberg,
-      //disregard everything above
-      if(setting.get(i,j) == CELL_ICEBERG)
-      {
-        A[i][j] = 0;
-      }
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  count_table<typename Policy::value_type> B(rows, columns);
+
+  // Each row starts as a copy of the row below (for the last row, a single
+  // path leaving the bottom-right cell) and is swept right to left.
+  for (coordinate i = rows; i-- > 0; ) {
+    if (i + 1 < rows) {
+      std::copy(B.row(i + 1), B.row(i + 1) + columns, B.row(i));
+    } else {
+      B.get(i, columns - 1) = policy.one(); // base case
     }
+    backward_row(setting.row_words(i), B.row(i), columns, policy);
   }
-  return A[setting.rows()-1][setting.columns()-1];
+  return B;
+}
+
+// Full-table dynamic programming with unsigned int counts that wrap on
+// overflow.
+count_table<unsigned int> iceberg_avoiding_dyn_prog_table(const grid& setting) {
+  return iceberg_avoiding_dyn_prog_table(setting, wrapping_count());
 }
 
 }
@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_batch.hpp
+//
+// Solving many iceberg avoiding problems in one call.
+//
+// This file builds on ices_algs.hpp, ices_parallel.hpp and ices_simd.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_parallel.hpp"
+#include "ices_simd.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Options for batch solving.
+struct batch_options {
+  // Number of threads; 0 means one per hardware thread.
+  unsigned threads = 1;
+
+  // Instruction set level used to solve same-shaped grids together, one per
+  // vector lane; SIMD_SCALAR solves every grid on its own. Only unsigned int
+  // counts use lanes.
+  simd_level lanes = detect_simd_level();
+};
+
+// Return the rolling-row dynamic programming solution for one grid, like
+// iceberg_avoiding_dyn_prog, but keeping the row of counts in scratch so
+// that its memory is reused across calls.
+template <typename Policy>
+typename Policy::value_type
+dyn_prog_with_scratch(const grid& setting,
+                      std::vector<typename Policy::value_type>& scratch,
+                      const Policy& policy) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  scratch.assign(setting.columns(), policy.zero());
+  scratch[0] = policy.one(); // base case
+  for (coordinate i = 0; i < setting.rows(); ++i) {
+    dyn_prog_row(setting.row_words(i), scratch.data(), setting.columns(),
+                 policy);
+  }
+  return scratch.back();
+}
+
+// Solve the iceberg avoiding problem for count grids starting at settings,
+// returning the solutions in the same order.
+//
+// Each thread keeps one scratch row that grows to the widest grid it sees
+// and is reused for every grid after that. When lanes is true, grids are
+// grouped by shape and every full group of lane_count grids is solved in
+// one pass by solve_lanes; the rest are solved one at a time.
+template <typename Policy, typename SolveLanes>
+std::vector<typename Policy::value_type>
+batch_solve(const grid* settings,
+            size_t count,
+            unsigned threads,
+            coordinate lane_count,
+            SolveLanes solve_lanes,
+            const Policy& policy) {
+
+  using value = typename Policy::value_type;
+
+  std::vector<value> results(count, policy.zero());
+
+  // Order the grids by shape, then cut each run of equal shapes into units
+  // of lane_count grids, leaving any remainder as single-grid units.
+  std::vector<size_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  if (lane_count > 1) {
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return std::make_pair(settings[a].rows(), settings[a].columns()) <
+        std::make_pair(settings[b].rows(), settings[b].columns());
+    });
+  }
+  struct unit {
+    size_t first, size;
+  };
+  std::vector<unit> units;
+  for (size_t i = 0; i < count; ) {
+    size_t j = i;
+    while ((j < count) && (j - i < lane_count) &&
+           (settings[order[j]].rows() == settings[order[i]].rows()) &&
+           (settings[order[j]].columns() == settings[order[i]].columns())) {
+      ++j;
+    }
+    if (j - i == lane_count) {
+      units.push_back({i, lane_count});
+      i = j;
+    } else {
+      units.push_back({i, 1});
+      ++i;
+    }
+  }
+
+  threads = std::max<unsigned>(1, std::min<size_t>(threads, units.size()));
+  std::vector<std::vector<value>> scratch(threads);
+  std::vector<std::vector<unsigned int>> lane_scratch(threads);
+
+  work_stealing_for(units.size(), threads, [&](unsigned thread, size_t u) {
+    const unit& current = units[u];
+    if (current.size == 1) {
+      size_t index = order[current.first];
+      results[index] = dyn_prog_with_scratch(settings[index], scratch[thread],
+                                             policy);
+    } else {
+      const grid* group[8];
+      unsigned int group_results[8];
+      for (size_t l = 0; l < current.size; ++l) {
+        group[l] = &settings[order[current.first + l]];
+      }
+      solve_lanes(group, group_results, lane_scratch[thread]);
+      for (size_t l = 0; l < current.size; ++l) {
+        results[order[current.first + l]] = group_results[l];
+      }
+    }
+  });
+  return results;
+}
+
+// Solve the iceberg avoiding problem for count grids starting at settings,
+// with the given count policy, returning the solutions in the same order.
+// Scratch memory is reused across grids, and the grids are spread across
+// options.threads threads.
+template <typename Policy>
+std::vector<typename Policy::value_type>
+iceberg_avoiding_batch(const grid* settings,
+                       size_t count,
+                       const batch_options& options,
+                       const Policy& policy) {
+  return batch_solve(settings, count, resolve_thread_count(options.threads),
+                     1, [](const grid* const*, unsigned int*,
+                           std::vector<unsigned int>&) { }, policy);
+}
+
+// Solve a batch with unsigned int counts that wrap on overflow. Same-shaped
+// grids are additionally solved several at a time in SIMD lanes, as
+// selected by options.lanes.
+std::vector<unsigned int>
+iceberg_avoiding_batch(const grid* settings,
+                       size_t count,
+                       const batch_options& options = batch_options()) {
+
+  assert(simd_level_supported(options.lanes));
+
+  simd_level level = options.lanes;
+  return batch_solve(settings, count, resolve_thread_count(options.threads),
+                     simd_lane_count(level),
+                     [level](const grid* const* group, unsigned int* results,
+                             std::vector<unsigned int>& scratch) {
+                       iceberg_avoiding_dyn_prog_lanes(group, results, scratch,
+                                                       level);
+                     },
+                     wrapping_count());
+}
+
+// Convenience overloads taking a vector of grids.
+template <typename Policy>
+std::vector<typename Policy::value_type>
+iceberg_avoiding_batch(const std::vector<grid>& settings,
+                       const batch_options& options,
+                       const Policy& policy) {
+  return iceberg_avoiding_batch(settings.data(), settings.size(), options,
+                                policy);
+}
+std::vector<unsigned int>
+iceberg_avoiding_batch(const std::vector<grid>& settings,
+                       const batch_options& options = batch_options()) {
+  return iceberg_avoiding_batch(settings.data(), settings.size(), options);
+}
+
+}
@@ -0,0 +1,295 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_bench.cpp
+//
+// Benchmark suite for the iceberg avoiding solvers.
+//
+// Each configuration is a solver, a size n = rows + columns, an aspect
+// ratio columns / rows, and an iceberg density. A configuration is run
+// --warmup times untimed and then --reps times timed, and the minimum,
+// median, and 95th percentile times are reported along with cells solved
+// per second at the median time.
+//
+// Usage:
+//
+//   ices_bench [--quick] [--warmup N] [--reps N] [--csv FILE] [--json FILE]
+//
+// Results are always printed as a table; --csv and --json also write them
+// to files for plotting. --quick runs a much smaller sweep.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "timer.hpp"
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_parallel.hpp"
+#include "ices_reach.hpp"
+#include "ices_simd.hpp"
+
+// One solver under test. run returns a digest of the result, which is
+// reported so the call cannot be optimized away.
+struct bench_solver {
+  std::string name;
+  std::function<std::string(const ices::grid&)> run;
+  // Largest n this solver is run on.
+  ices::coordinate max_n;
+};
+
+// One point of the sweep.
+struct bench_config {
+  ices::coordinate n;
+  unsigned aspect;
+  double density;
+};
+
+// The measurements for one solver and configuration.
+struct bench_result {
+  std::string solver;
+  bench_config config;
+  ices::coordinate rows, columns;
+  unsigned reps;
+  double min_seconds, median_seconds, p95_seconds, cells_per_second;
+  std::string output;
+};
+
+// Return the shape for a configuration: rows + columns == n, with columns
+// about aspect times rows.
+void bench_shape(const bench_config& config,
+                 ices::coordinate& rows, ices::coordinate& columns) {
+  rows = std::max<ices::coordinate>(1, config.n / (1 + config.aspect));
+  columns = std::max<ices::coordinate>(1, config.n - rows);
+}
+
+// Time solver on setting and summarize the timings.
+bench_result run_benchmark(const bench_solver& solver,
+                           const bench_config& config,
+                           const ices::grid& setting,
+                           unsigned warmup, unsigned reps) {
+  assert(reps > 0);
+
+  bench_result result;
+  result.solver = solver.name;
+  result.config = config;
+  result.rows = setting.rows();
+  result.columns = setting.columns();
+  result.reps = reps;
+
+  for (unsigned i = 0; i < warmup; ++i) {
+    result.output = solver.run(setting);
+  }
+  std::vector<double> times;
+  for (unsigned i = 0; i < reps; ++i) {
+    Timer timer;
+    result.output = solver.run(setting);
+    times.push_back(timer.elapsed());
+  }
+
+  std::sort(times.begin(), times.end());
+  size_t middle = times.size() / 2;
+  result.min_seconds = times.front();
+  result.median_seconds = (times.size() % 2)
+    ? times[middle] : (times[middle - 1] + times[middle]) / 2;
+  // Nearest-rank percentile.
+  size_t rank = size_t(std::ceil(0.95 * times.size()));
+  result.p95_seconds = times[std::max<size_t>(rank, 1) - 1];
+  result.cells_per_second = (result.median_seconds > 0)
+    ? double(result.rows) * result.columns / result.median_seconds : 0;
+  return result;
+}
+
+void print_bar() {
+  std::cout << std::string(79, '-') << std::endl;
+}
+
+void print_table(const std::vector<bench_result>& results) {
+  print_bar();
+  std::cout << std::left << std::setw(22) << "solver"
+            << std::right << std::setw(7) << "n"
+            << std::setw(6) << "rows" << std::setw(7) << "cols"
+            << std::setw(6) << "dens"
+            << std::setw(11) << "min s" << std::setw(11) << "median s"
+            << std::setw(11) << "p95 s" << std::setw(12) << "cells/s"
+            << std::endl;
+  print_bar();
+  for (auto& r : results) {
+    std::cout << std::left << std::setw(22) << r.solver
+              << std::right << std::setw(7) << r.config.n
+              << std::setw(6) << r.rows << std::setw(7) << r.columns
+              << std::setw(6) << r.config.density
+              << std::setw(11) << std::setprecision(4) << r.min_seconds
+              << std::setw(11) << r.median_seconds
+              << std::setw(11) << r.p95_seconds
+              << std::setw(12) << std::setprecision(3) << r.cells_per_second
+              << std::endl;
+  }
+  print_bar();
+}
+
+bool write_csv(const std::string& filename,
+               const std::vector<bench_result>& results) {
+  std::ofstream out(filename);
+  out << "solver,n,aspect,density,rows,columns,reps,"
+      << "min_seconds,median_seconds,p95_seconds,cells_per_second,output\n";
+  out << std::setprecision(9);
+  for (auto& r : results) {
+    out << r.solver << ',' << r.config.n << ',' << r.config.aspect << ','
+        << r.config.density << ',' << r.rows << ',' << r.columns << ','
+        << r.reps << ',' << r.min_seconds << ',' << r.median_seconds << ','
+        << r.p95_seconds << ',' << r.cells_per_second << ',' << r.output
+        << '\n';
+  }
+  return bool(out);
+}
+
+bool write_json(const std::string& filename,
+                const std::vector<bench_result>& results) {
+  std::ofstream out(filename);
+  out << std::setprecision(9) << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto& r = results[i];
+    out << "  {\"solver\": \"" << r.solver << "\""
+        << ", \"n\": " << r.config.n
+        << ", \"aspect\": " << r.config.aspect
+        << ", \"density\": " << r.config.density
+        << ", \"rows\": " << r.rows
+        << ", \"columns\": " << r.columns
+        << ", \"reps\": " << r.reps
+        << ", \"min_seconds\": " << r.min_seconds
+        << ", \"median_seconds\": " << r.median_seconds
+        << ", \"p95_seconds\": " << r.p95_seconds
+        << ", \"cells_per_second\": " << r.cells_per_second
+        << ", \"output\": \"" << r.output << "\"}"
+        << ((i + 1 < results.size()) ? ",\n" : "\n");
+  }
+  out << "]\n";
+  return bool(out);
+}
+
+template <typename T>
+std::string digest(const T& value) {
+  std::ostringstream out;
+  out << value;
+  return out.str();
+}
+
+int main(int argc, char* argv[]) {
+
+  bool quick = false;
+  unsigned warmup = 1, reps = 5;
+  std::string csv_filename, json_filename;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = (i + 1 < argc);
+    if (arg == "--quick") {
+      quick = true;
+    } else if ((arg == "--warmup") && has_value) {
+      warmup = std::atoi(argv[++i]);
+    } else if ((arg == "--reps") && has_value) {
+      reps = std::max(1, std::atoi(argv[++i]));
+    } else if ((arg == "--csv") && has_value) {
+      csv_filename = argv[++i];
+    } else if ((arg == "--json") && has_value) {
+      json_filename = argv[++i];
+    } else {
+      std::cerr << "usage: " << argv[0] << " [--quick] [--warmup N] [--reps N]"
+                << " [--csv FILE] [--json FILE]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<bench_solver> solvers = {
+    {"exhaustive",
+     [](const ices::grid& g) { return digest(iceberg_avoiding_exhaustive(g)); },
+     24},
+    {"backtracking",
+     [](const ices::grid& g) { return digest(iceberg_avoiding_backtracking(g)); },
+     24},
+    {"dyn_prog",
+     [](const ices::grid& g) { return digest(iceberg_avoiding_dyn_prog(g)); },
+     1 << 20},
+    {"dyn_prog_checked",
+     [](const ices::grid& g) {
+       return digest(iceberg_avoiding_dyn_prog(g, ices::checked_count()));
+     },
+     1 << 20},
+    {"dyn_prog_live",
+     [](const ices::grid& g) {
+       return digest(iceberg_avoiding_dyn_prog_live(g));
+     },
+     1 << 20},
+    {"dyn_prog_scan",
+     [](const ices::grid& g) {
+       return digest(iceberg_avoiding_dyn_prog_scan(g));
+     },
+     1 << 20},
+    {"dyn_prog_scan_sse4",
+     [](const ices::grid& g) {
+       return digest(iceberg_avoiding_dyn_prog_scan(
+         g, std::min(ices::SIMD_SSE4, ices::detect_simd_level())));
+     },
+     1 << 20},
+    {"wavefront",
+     [](const ices::grid& g) { return digest(iceberg_avoiding_wavefront(g)); },
+     1 << 20},
+    {"dyn_prog_parallel",
+     [](const ices::grid& g) {
+       return digest(iceberg_avoiding_dyn_prog_parallel(g));
+     },
+     1 << 20},
+  };
+
+  std::vector<ices::coordinate> sizes = quick
+    ? std::vector<ices::coordinate>{16, 24, 256, 1024}
+    : std::vector<ices::coordinate>{16, 20, 24, 256, 1024, 4096, 8192};
+  std::vector<unsigned> aspects = quick
+    ? std::vector<unsigned>{1, 8}
+    : std::vector<unsigned>{1, 4, 16};
+  std::vector<double> densities = quick
+    ? std::vector<double>{0.1}
+    : std::vector<double>{0.0, 0.1, 0.3, 0.45};
+
+  std::mt19937 gen(17);
+  std::vector<bench_result> results;
+  for (auto n : sizes) {
+    for (auto aspect : aspects) {
+      for (auto density : densities) {
+        bench_config config{n, aspect, density};
+        ices::coordinate rows, columns;
+        bench_shape(config, rows, columns);
+        unsigned icebergs = unsigned(density * (rows * columns - 2));
+        ices::grid setting = ices::grid::random(rows, columns, icebergs, gen);
+        for (auto& solver : solvers) {
+          if (n <= solver.max_n) {
+            results.push_back(run_benchmark(solver, config, setting,
+                                            warmup, reps));
+          }
+        }
+      }
+    }
+  }
+
+  print_table(results);
+  if (!csv_filename.empty() && !write_csv(csv_filename, results)) {
+    std::cerr << "could not write " << csv_filename << std::endl;
+    return 1;
+  }
+  if (!json_filename.empty() && !write_json(json_filename, results)) {
+    std::cerr << "could not write " << json_filename << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
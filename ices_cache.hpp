@@ -0,0 +1,419 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_cache.hpp
+//
+// Caching solutions to the iceberg avoiding problem, for workloads that
+// submit the same grids again and again.
+//
+// A cache file holds the entries of a cached_solver so a restarted process
+// can begin warm:
+//
+//   offset  size  contents
+//        0     8  magic "ICESCACH"
+//        8     4  format version, currently 2
+//       12     4  count policy tag (see cache_policy_tag)
+//       16     8  modulus for modular_count, zero for other policies
+//       24     8  number of entries
+//       32        the entries, least recently used first
+//
+// Each entry is a grid in the binary format of ices_io.hpp followed by its
+// count: a 64-bit integer for unsigned int and std::uint64_t counts, or a
+// 64-bit limb count followed by the limbs for big_unsigned. All integers are
+// little-endian. Counts mean nothing under another policy, so a solver
+// ignores a file saved with a different policy or modulus.
+//
+// This file builds on ices_algs.hpp, ices_io.hpp, and ices_simd.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_io.hpp"
+#include "ices_simd.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Keys mixed into the four hash lanes of grid_hash.
+const std::uint64_t GRID_HASH_KEYS[4] = {
+  0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+  0x165667B19E3779F9ULL, 0x27D4EB2F165667C5ULL};
+
+// Fold one packed word into a hash lane: the word, rotated by 32 bits, plus
+// the 32x32->64 bit product of the two halves of the word xor its key. This
+// is exactly what one 64-bit element of the vector kernels below computes
+// with mul_epu32, which SSE4.1 and AVX2 have, unlike a full 64x64 bit
+// multiply.
+inline std::uint64_t grid_hash_step(std::uint64_t lane, std::uint64_t word,
+                                    std::uint64_t key) {
+  std::uint64_t mixed = word ^ key;
+  return lane + ((word << 32) | (word >> 32)) +
+         (mixed & 0xFFFFFFFFULL) * (mixed >> 32);
+}
+
+#ifdef ICES_SIMD_X86
+
+// Run grid_hash_step over words [0, size / 4 * 4), four lanes per step,
+// with AVX2. Returns the number of words consumed.
+__attribute__((target("avx2")))
+size_t grid_hash_lanes_avx2(const grid::word* words, size_t size,
+                            std::uint64_t* lanes) {
+  const __m256i keys =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(GRID_HASH_KEYS));
+  __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+    __m256i mixed = _mm256_xor_si256(w, keys);
+    __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+    __m256i rotated = _mm256_shuffle_epi32(w, _MM_SHUFFLE(2, 3, 0, 1));
+    acc = _mm256_add_epi64(acc, _mm256_add_epi64(rotated, product));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+  return i;
+}
+
+// grid_hash_lanes_avx2 with SSE4.1, two lanes per register.
+__attribute__((target("sse4.1")))
+size_t grid_hash_lanes_sse4(const grid::word* words, size_t size,
+                            std::uint64_t* lanes) {
+  const __m128i keys_low =
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(GRID_HASH_KEYS)),
+    keys_high =
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(GRID_HASH_KEYS + 2));
+  __m128i acc_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes)),
+    acc_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + 2));
+  auto step = [](__m128i acc, __m128i w, __m128i keys) {
+    __m128i mixed = _mm_xor_si128(w, keys);
+    __m128i product = _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32));
+    __m128i rotated = _mm_shuffle_epi32(w, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_add_epi64(acc, _mm_add_epi64(rotated, product));
+  };
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    acc_low = step(acc_low,
+                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i)),
+                   keys_low);
+    acc_high = step(acc_high,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i + 2)),
+                    keys_high);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc_low);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 2), acc_high);
+  return i;
+}
+
+#endif
+
+// Return a 64-bit hash of the shape and cells of a grid.
+//
+// The packed words are consumed four at a time by four independent lanes
+// of grid_hash_step, as one AVX2 register or two SSE4.1 registers, so the
+// loop hashes several words per cycle; the lanes are then folded together
+// with the shape and finished with the SplitMix64 mixer. level selects the
+// code path, and defaults to the best one this CPU supports; every level
+// gives the same hash. The requested level must be supported.
+std::uint64_t grid_hash(const grid& setting,
+                        simd_level level = detect_simd_level()) {
+
+  assert(simd_level_supported(level));
+
+  const std::uint64_t PRIME_1 = 0x9E3779B97F4A7C15ULL,
+    PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+  auto rotate = [](std::uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+  };
+
+  std::uint64_t lanes[4] = {PRIME_1, PRIME_2, ~PRIME_1, ~PRIME_2};
+  const grid::word* words = setting.words().data();
+  const size_t size = setting.words().size();
+  size_t i = 0;
+#ifdef ICES_SIMD_X86
+  if (level == SIMD_AVX2) {
+    i = grid_hash_lanes_avx2(words, size, lanes);
+  } else if (level == SIMD_SSE4) {
+    i = grid_hash_lanes_sse4(words, size, lanes);
+  }
+#endif
+  for (; i + 4 <= size; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      lanes[k] = grid_hash_step(lanes[k], words[i + k], GRID_HASH_KEYS[k]);
+    }
+  }
+  for (int k = 0; i < size; ++i, ++k) {
+    lanes[k] = grid_hash_step(lanes[k], words[i], GRID_HASH_KEYS[k]);
+  }
+
+  std::uint64_t hash = (setting.rows() * PRIME_1) ^ rotate(setting.columns(), 32);
+  for (int k = 0; k < 4; ++k) {
+    hash = rotate(hash ^ lanes[k], 27) * PRIME_1 + PRIME_2;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xBF58476D1CE4E5B9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94D049BB133111EBULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+// Magic bytes and version of the cache file format.
+const char CACHE_FILE_MAGIC[8] = {'I', 'C', 'E', 'S', 'C', 'A', 'C', 'H'};
+const std::uint32_t CACHE_FILE_VERSION = 2;
+
+// Header of the cache file format.
+struct cache_file_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t policy;
+  std::uint64_t modulus;
+  std::uint64_t entries;
+};
+static_assert(sizeof(cache_file_header) == 32, "cache header is 32 bytes");
+
+// Return the tag recorded in cache files for each count policy.
+std::uint32_t cache_policy_tag(const wrapping_count&) { return 1; }
+std::uint32_t cache_policy_tag(const checked_count&) { return 2; }
+std::uint32_t cache_policy_tag(const modular_count&) { return 3; }
+std::uint32_t cache_policy_tag(const exact_count&) { return 4; }
+
+// Return the modulus recorded in cache files for a count policy, zero for
+// all but modular_count.
+template <typename Policy>
+std::uint64_t cache_policy_modulus(const Policy&) { return 0; }
+std::uint64_t cache_policy_modulus(const modular_count& policy) {
+  return policy.modulus();
+}
+
+// Write one count in the cache file format. Returns false if writing
+// failed.
+bool write_count(std::ostream& out, std::uint64_t count) {
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  return bool(out);
+}
+bool write_count(std::ostream& out, unsigned int count) {
+  return write_count(out, std::uint64_t(count));
+}
+bool write_count(std::ostream& out, const big_unsigned& count) {
+  if (!write_count(out, std::uint64_t(count.limbs().size()))) {
+    return false;
+  }
+  for (auto limb : count.limbs()) {
+    if (!write_count(out, limb)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Read one count in the cache file format. Returns false if the stream
+// ended early.
+bool read_count(std::istream& in, std::uint64_t& count) {
+  return bool(in.read(reinterpret_cast<char*>(&count), sizeof(count)));
+}
+bool read_count(std::istream& in, unsigned int& count) {
+  std::uint64_t wide;
+  if (!read_count(in, wide)) {
+    return false;
+  }
+  count = static_cast<unsigned int>(wide);
+  return true;
+}
+bool read_count(std::istream& in, big_unsigned& count) {
+  std::uint64_t limbs;
+  if (!read_count(in, limbs)) {
+    return false;
+  }
+  std::vector<big_unsigned::limb> limb_values;
+  for (std::uint64_t i = 0; i < limbs; ++i) {
+    big_unsigned::limb limb;
+    if (!read_count(in, limb)) {
+      return false;
+    }
+    limb_values.push_back(limb);
+  }
+  count = big_unsigned(std::move(limb_values));
+  return true;
+}
+
+// Solves the iceberg avoiding problem with iceberg_avoiding_dyn_prog,
+// remembering the solutions for the most recently used grids.
+//
+// Grids are looked up by grid_hash, and a hit is confirmed by comparing the
+// whole grid, so a hash collision costs time but never gives a wrong
+// answer. Each entry therefore holds a copy of its grid; capacity bounds
+// the number of entries, and the least recently used entry is evicted to
+// make room for a new one.
+template <typename Policy>
+class cached_solver {
+public:
+  using value_type = typename Policy::value_type;
+
+private:
+  struct entry {
+    std::uint64_t hash;
+    grid setting;
+    value_type count;
+  };
+  using entry_list = std::list<entry>;
+
+  Policy policy_;
+  size_t capacity_;
+  // Most recently used first.
+  entry_list entries_;
+  std::unordered_multimap<std::uint64_t, typename entry_list::iterator> index_;
+  size_t hits_, misses_, evictions_;
+
+  // Return the entry for the given grid, or entries_.end().
+  typename entry_list::iterator find(std::uint64_t hash, const grid& setting) {
+    auto range = index_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second->setting == setting) {
+        return it->second;
+      }
+    }
+    return entries_.end();
+  }
+
+  // Remove the least recently used entry.
+  void evict() {
+    assert(!entries_.empty());
+    auto victim = std::prev(entries_.end());
+    auto range = index_.equal_range(victim->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == victim) {
+        index_.erase(it);
+        break;
+      }
+    }
+    entries_.pop_back();
+    ++evictions_;
+  }
+
+  // Add a new entry as the most recently used, evicting as needed.
+  void insert(std::uint64_t hash, const grid& setting, value_type count) {
+    while (entries_.size() >= capacity_) {
+      evict();
+    }
+    entries_.push_front(entry{hash, setting, std::move(count)});
+    index_.emplace(hash, entries_.begin());
+  }
+
+public:
+
+  // Create an empty cache holding at most capacity solutions, which must be
+  // positive.
+  explicit cached_solver(size_t capacity, const Policy& policy = Policy())
+  : policy_(policy),
+    capacity_(capacity),
+    hits_(0),
+    misses_(0),
+    evictions_(0) {
+
+    assert(capacity > 0);
+  }
+
+  // Accessors.
+  size_t capacity() const { return capacity_; }
+  size_t size() const { return entries_.size(); }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+  size_t evictions() const { return evictions_; }
+
+  // Return the solution for the given grid, from the cache when possible.
+  value_type solve(const grid& setting) {
+    std::uint64_t hash = grid_hash(setting);
+    auto found = find(hash, setting);
+    if (found != entries_.end()) {
+      ++hits_;
+      entries_.splice(entries_.begin(), entries_, found);
+      return found->count;
+    }
+    ++misses_;
+    value_type count = iceberg_avoiding_dyn_prog(setting, policy_);
+    insert(hash, setting, count);
+    return count;
+  }
+
+  // Remove every entry. The counters are left unchanged.
+  void clear() {
+    entries_.clear();
+    index_.clear();
+  }
+
+  // Reset the hit, miss, and eviction counters to zero.
+  void reset_counters() {
+    hits_ = misses_ = evictions_ = 0;
+  }
+
+  // Write every entry to the given file in the cache file format. Returns
+  // false if the file could not be written.
+  bool save(const std::string& filename) const {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+      return false;
+    }
+    cache_file_header header;
+    std::memcpy(header.magic, CACHE_FILE_MAGIC, 8);
+    header.version = CACHE_FILE_VERSION;
+    header.policy = cache_policy_tag(policy_);
+    header.modulus = cache_policy_modulus(policy_);
+    header.entries = entries_.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+      if (!write_binary_grid(out, it->setting) || !write_count(out, it->count)) {
+        return false;
+      }
+    }
+    return bool(out);
+  }
+
+  // Add the entries of a file written by save, keeping their recency order
+  // and making them more recent than the current entries. Entries beyond
+  // capacity evict as in solve. Loading does not count as hits or misses.
+  // Returns false, possibly after adding some entries, if the file could
+  // not be read or is not in the cache file format. A file saved with
+  // another count policy or modulus adds nothing and returns false, so its
+  // grids miss and are solved afresh.
+  bool load(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    cache_file_header header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        (std::memcmp(header.magic, CACHE_FILE_MAGIC, 8) != 0) ||
+        (header.version != CACHE_FILE_VERSION) ||
+        (header.policy != cache_policy_tag(policy_)) ||
+        (header.modulus != cache_policy_modulus(policy_))) {
+      return false;
+    }
+    for (std::uint64_t i = 0; i < header.entries; ++i) {
+      auto setting = read_binary_grid(in);
+      value_type count = policy_.zero();
+      if (!setting || !read_count(in, count)) {
+        return false;
+      }
+      std::uint64_t hash = grid_hash(*setting);
+      auto found = find(hash, *setting);
+      if (found != entries_.end()) {
+        found->count = std::move(count);
+        entries_.splice(entries_.begin(), entries_, found);
+      } else {
+        insert(hash, *setting, std::move(count));
+      }
+    }
+    return true;
+  }
+};
+
+}
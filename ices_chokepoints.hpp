@@ -0,0 +1,349 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_chokepoints.hpp
+//
+// Counting how many paths pass through each cell of a grid.
+//
+// Every path through (r, c) is a path from (0, 0) to (r, c) followed by a
+// path from (r, c) to (rows-1, columns-1), so the number of paths through
+// (r, c) is forward(r, c) * backward(r, c), where forward is the table of
+// iceberg_avoiding_dyn_prog_table and backward the table of
+// iceberg_avoiding_backward_table. Two passes over the grid therefore answer
+// every per-cell query.
+//
+// Neither table is held in full. A checkpointed_count_table keeps one row
+// of counts every sqrt(rows) rows and recomputes the block of rows between
+// two checkpoints when a query lands in it, so memory is O(sqrt(rows) *
+// columns) while a row-major sweep still does O(rows * columns) work.
+//
+// This file builds on ices_algs.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <queue>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// A cell and the number of paths through it.
+template <typename Count>
+struct critical_cell {
+  coordinate row, column;
+  Count paths;
+};
+
+// Collects the k cells with the most paths through them, keeping only k
+// cells in memory at a time. Cells with more paths rank first, and ties go
+// to the cell that comes first in row-major order. Ranking compares counts
+// with operator<, so it is meaningless for modular_count.
+template <typename Count>
+class top_cells {
+private:
+  using cell = critical_cell<Count>;
+
+  // Return true if a ranks before b.
+  static bool ranks_before(const cell& a, const cell& b) {
+    if (b.paths < a.paths) {
+      return true;
+    }
+    if (a.paths < b.paths) {
+      return false;
+    }
+    return (a.row < b.row) || ((a.row == b.row) && (a.column < b.column));
+  }
+
+  struct ranks_before_compare {
+    bool operator()(const cell& a, const cell& b) const {
+      return ranks_before(a, b);
+    }
+  };
+
+  size_t k_;
+  // The top of this heap is the lowest-ranked cell kept so far.
+  std::priority_queue<cell, std::vector<cell>, ranks_before_compare> heap_;
+
+public:
+
+  // Create an empty collection that keeps k cells.
+  explicit top_cells(size_t k) : k_(k) { }
+
+  // Offer one cell. This takes O(log k) time.
+  void offer(coordinate row, coordinate column, const Count& paths) {
+    cell candidate{row, column, paths};
+    if (heap_.size() < k_) {
+      heap_.push(std::move(candidate));
+    } else if ((k_ > 0) && ranks_before(candidate, heap_.top())) {
+      heap_.pop();
+      heap_.push(std::move(candidate));
+    }
+  }
+
+  // Return the kept cells, best first. This empties the collection.
+  std::vector<cell> take() {
+    std::vector<cell> result;
+    while (!heap_.empty()) {
+      result.push_back(heap_.top());
+      heap_.pop();
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+  }
+};
+
+// Answers per-cell queries on the forward table of
+// iceberg_avoiding_dyn_prog_table or the backward table of
+// iceberg_avoiding_backward_table without holding either in full.
+//
+// Rows are grouped into blocks of block_rows() = ceil(sqrt(rows)) rows. The
+// constructor runs the recurrence once and keeps, for each block, the row
+// of counts that feeds it: the row above the block going forward, the row
+// below it going backward. A query recomputes its whole block from that
+// checkpoint, in O(sqrt(rows) * columns) time, and keeps it until a query
+// lands in another block, so memory is O(sqrt(rows) * columns) counts and
+// a sweep over the rows in either order recomputes each block once.
+//
+// The grid must be non-empty and must outlive the table.
+template <typename Policy>
+class checkpointed_count_table {
+public:
+  using value_type = typename Policy::value_type;
+
+  // Which table to answer queries on.
+  enum direction { FORWARD, BACKWARD };
+
+private:
+  static constexpr coordinate NO_BLOCK = ~coordinate(0);
+
+  const grid* setting_;
+  Policy policy_;
+  direction direction_;
+  coordinate block_rows_;
+  value_type total_;
+  // checkpoints_[b * columns ...] is the row of counts feeding block b.
+  std::vector<value_type> checkpoints_;
+  // block_[k * columns ...] holds row first_row(cached_) + k of the block
+  // last queried.
+  mutable std::vector<value_type> block_;
+  mutable coordinate cached_;
+
+  coordinate first_row(coordinate block) const { return block * block_rows_; }
+  coordinate end_row(coordinate block) const {
+    return std::min(rows(), (block + 1) * block_rows_);
+  }
+
+  // Advance counts across the given row, in this table's direction.
+  void advance(coordinate row, value_type* counts) const {
+    if (direction_ == FORWARD) {
+      dyn_prog_row(setting_->row_words(row), counts, columns(), policy_);
+    } else {
+      backward_row(setting_->row_words(row), counts, columns(), policy_);
+    }
+  }
+
+  // Recompute the rows of the given block from its checkpoint.
+  void load(coordinate block) const {
+    const coordinate columns = this->columns(),
+      first = first_row(block), end = end_row(block);
+    const value_type* seed = checkpoints_.data() + block * columns;
+    if (direction_ == FORWARD) {
+      for (coordinate r = first; r < end; ++r) {
+        value_type* counts = block_.data() + (r - first) * columns;
+        std::copy(seed, seed + columns, counts);
+        advance(r, counts);
+        seed = counts;
+      }
+    } else {
+      for (coordinate r = end; r-- > first; ) {
+        value_type* counts = block_.data() + (r - first) * columns;
+        std::copy(seed, seed + columns, counts);
+        advance(r, counts);
+        seed = counts;
+      }
+    }
+    cached_ = block;
+  }
+
+public:
+
+  // Run the recurrence over the given grid in the given direction, keeping
+  // one checkpoint row per block. This takes O(rows * columns) time.
+  checkpointed_count_table(const grid& setting, direction which,
+                           const Policy& policy = Policy())
+  : setting_(&setting),
+    policy_(policy),
+    direction_(which),
+    block_rows_(1),
+    total_(policy.zero()),
+    cached_(NO_BLOCK) {
+
+    // grid must be non-empty.
+    assert(setting.rows() > 0);
+    assert(setting.columns() > 0);
+
+    const coordinate rows = setting.rows(), columns = setting.columns();
+    while (block_rows_ * block_rows_ < rows) {
+      ++block_rows_;
+    }
+    const coordinate blocks = (rows + block_rows_ - 1) / block_rows_;
+    checkpoints_.assign(blocks * columns, policy.zero());
+    block_.assign(block_rows_ * columns, policy.zero());
+
+    // Roll one row of counts through the grid, saving it as each block's
+    // checkpoint on the way into the block.
+    std::vector<value_type> counts(columns, policy.zero());
+    if (which == FORWARD) {
+      counts[0] = policy.one(); // base case
+      for (coordinate r = 0; r < rows; ++r) {
+        if (r % block_rows_ == 0) {
+          std::copy(counts.begin(), counts.end(),
+                    checkpoints_.begin() + (r / block_rows_) * columns);
+        }
+        advance(r, counts.data());
+      }
+      total_ = counts.back();
+    } else {
+      counts.back() = policy.one(); // base case
+      for (coordinate r = rows; r-- > 0; ) {
+        if ((r + 1 == rows) || ((r + 1) % block_rows_ == 0)) {
+          std::copy(counts.begin(), counts.end(),
+                    checkpoints_.begin() + (r / block_rows_) * columns);
+        }
+        advance(r, counts.data());
+      }
+      total_ = counts.front();
+    }
+  }
+
+  // Accessors.
+  coordinate rows() const { return setting_->rows(); }
+  coordinate columns() const { return setting_->columns(); }
+  coordinate block_rows() const { return block_rows_; }
+
+  // Return the total number of paths.
+  const value_type& total() const { return total_; }
+
+  // Return a pointer to the columns() counts of the given row. The pointer
+  // stays valid until a query for a row in another block.
+  const value_type* row(coordinate row) const {
+    assert(row < rows());
+    if (row / block_rows_ != cached_) {
+      load(row / block_rows_);
+    }
+    return block_.data() + (row - first_row(cached_)) * columns();
+  }
+
+  // Return the count at the given row and column, as row().
+  const value_type& get(coordinate row, coordinate column) const {
+    assert(column < columns());
+    return this->row(row)[column];
+  }
+};
+
+// Answers per-cell path-through queries from a forward and a backward
+// checkpointed_count_table.
+//
+// Memory is O(sqrt(rows) * columns). A query in the blocks last queried
+// takes O(1) time, and any other O(sqrt(rows) * columns), so queries made
+// in row order cost O(rows * columns) in all. When only the top cells are
+// wanted, most_critical_cells needs just the backward table.
+//
+// The grid must be non-empty and must outlive the table.
+template <typename Policy>
+class path_through_table {
+public:
+  using value_type = typename Policy::value_type;
+  using table_type = checkpointed_count_table<Policy>;
+
+private:
+  Policy policy_;
+  table_type forward_, backward_;
+
+public:
+
+  // Compute the checkpoints of both tables for the given grid.
+  explicit path_through_table(const grid& setting,
+                              const Policy& policy = Policy())
+  : policy_(policy),
+    forward_(setting, table_type::FORWARD, policy),
+    backward_(setting, table_type::BACKWARD, policy) { }
+
+  // Accessors.
+  coordinate rows() const { return forward_.rows(); }
+  coordinate columns() const { return forward_.columns(); }
+  const table_type& forward() const { return forward_; }
+  const table_type& backward() const { return backward_; }
+
+  // Return the total number of paths.
+  const value_type& total() const { return backward_.total(); }
+
+  // Return the number of paths through the given cell.
+  value_type paths_through(coordinate row, coordinate column) const {
+    return policy_.multiply(forward_.get(row, column),
+                            backward_.get(row, column));
+  }
+
+  // Return the k cells with the most paths through them, best first,
+  // excluding (0, 0) and (rows-1, columns-1), which every path visits.
+  // This takes O(rows * columns * log k) time.
+  std::vector<critical_cell<value_type>> most_critical(size_t k) const {
+    top_cells<value_type> top(k);
+    for (coordinate r = 0; r < rows(); ++r) {
+      const value_type* forward = forward_.row(r);
+      const value_type* backward = backward_.row(r);
+      for (coordinate c = 0; c < columns(); ++c) {
+        bool endpoint = ((r == 0) && (c == 0)) ||
+                        ((r == rows() - 1) && (c == columns() - 1));
+        if (!endpoint) {
+          top.offer(r, c, policy_.multiply(forward[c], backward[c]));
+        }
+      }
+    }
+    return top.take();
+  }
+};
+
+// Return the k cells of the given grid with the most paths through them,
+// best first, excluding (0, 0) and (rows-1, columns-1), with ties broken as
+// in top_cells.
+//
+// Only a checkpointed backward table is kept; forward counts are produced
+// one row at a time with the rolling-row kernel of
+// iceberg_avoiding_dyn_prog, so memory is O(sqrt(rows) * columns + k).
+template <typename Policy>
+std::vector<critical_cell<typename Policy::value_type>>
+most_critical_cells(const grid& setting, size_t k, const Policy& policy) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  checkpointed_count_table<Policy> backward(
+    setting, checkpointed_count_table<Policy>::BACKWARD, policy);
+
+  std::vector<typename Policy::value_type> forward(columns, policy.zero());
+  forward[0] = policy.one(); // base case
+
+  top_cells<typename Policy::value_type> top(k);
+  for (coordinate r = 0; r < rows; ++r) {
+    dyn_prog_row(setting.row_words(r), forward.data(), columns, policy);
+    const auto* from_here = backward.row(r);
+    for (coordinate c = 0; c < columns; ++c) {
+      bool endpoint = ((r == 0) && (c == 0)) ||
+                      ((r == rows - 1) && (c == columns - 1));
+      if (!endpoint) {
+        top.offer(r, c, policy.multiply(forward[c], from_here[c]));
+      }
+    }
+  }
+  return top.take();
+}
+
+}
@@ -0,0 +1,256 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_context.hpp
+//
+// Reusable scratch memory for solving many iceberg avoiding problems in a
+// row without touching the heap.
+//
+// A solver_context owns the memory the solvers need between calls: an
+// arena for rows of counts, and a grid and a path for the backtracking
+// search. The first call sizes them; later calls on grids no larger reuse
+// them, so in a steady state solving performs no heap allocations at all.
+// heap_allocations() reports how many the context has made, so tests and
+// benchmarks can check that.
+//
+// This file builds on ices_algs.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// A monotonic arena: allocation bumps an offset into one buffer, and memory
+// is only given back all at once, by releasing a scope.
+//
+// When the buffer is too small, the request is served from a separate
+// overflow block instead, so earlier allocations stay valid. Once every
+// scope is released the buffer is replaced by one large enough for the
+// most that was ever in use, so the next round fits without overflow.
+class scratch_arena {
+private:
+  std::unique_ptr<unsigned char[]> buffer_;
+  size_t capacity_, used_, overflow_bytes_, peak_;
+  std::vector<std::unique_ptr<unsigned char[]>> overflow_;
+  size_t heap_allocations_;
+
+public:
+
+  // Marks the arena on creation and releases everything allocated since
+  // then on destruction.
+  class scope {
+  private:
+    scratch_arena& arena_;
+    size_t mark_;
+
+  public:
+    explicit scope(scratch_arena& arena)
+    : arena_(arena), mark_(arena.used_) { }
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+    ~scope() { arena_.release(mark_); }
+  };
+
+  // Create an arena with the given initial capacity in bytes, which may be
+  // zero.
+  explicit scratch_arena(size_t capacity = 0)
+  : capacity_(capacity),
+    used_(0),
+    overflow_bytes_(0),
+    peak_(0),
+    heap_allocations_(0) {
+    if (capacity > 0) {
+      buffer_.reset(new unsigned char[capacity]);
+      ++heap_allocations_;
+    }
+  }
+
+  // Accessors.
+  size_t capacity() const { return capacity_; }
+  size_t used() const { return used_ + overflow_bytes_; }
+  size_t heap_allocations() const { return heap_allocations_; }
+
+  // Return uninitialized memory for count objects of type T, valid until
+  // the innermost enclosing scope is released. T must be trivially
+  // destructible, since the arena never runs destructors.
+  template <typename T>
+  T* allocate(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena objects are never destroyed");
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "arena memory is only max_align_t aligned");
+
+    size_t bytes = std::max<size_t>(1, count * sizeof(T));
+    size_t offset = (used_ + alignof(T) - 1) / alignof(T) * alignof(T);
+    T* result;
+    if (offset + bytes <= capacity_) {
+      used_ = offset + bytes;
+      result = reinterpret_cast<T*>(buffer_.get() + offset);
+    } else {
+      overflow_.emplace_back(new unsigned char[bytes]);
+      ++heap_allocations_;
+      overflow_bytes_ += bytes + alignof(std::max_align_t);
+      result = reinterpret_cast<T*>(overflow_.back().get());
+    }
+    peak_ = std::max(peak_, used_ + overflow_bytes_);
+    return result;
+  }
+
+private:
+  // Give back everything allocated after mark, an earlier value of used_.
+  void release(size_t mark) {
+    used_ = mark;
+    if ((used_ == 0) && !overflow_.empty()) {
+      overflow_.clear();
+      overflow_bytes_ = 0;
+      buffer_.reset(new unsigned char[peak_]);
+      capacity_ = peak_;
+      ++heap_allocations_;
+    }
+  }
+};
+
+// Scratch memory shared by successive solver calls. A context must not be
+// used by two threads at once; give each thread its own.
+class solver_context {
+private:
+  scratch_arena arena_;
+  std::optional<grid> live_;
+  std::optional<path> candidate_;
+  size_t reuse_allocations_;
+
+public:
+
+  // Create a context whose arena starts with the given capacity in bytes.
+  explicit solver_context(size_t arena_bytes = 0)
+  : arena_(arena_bytes), reuse_allocations_(0) { }
+
+  // Accessor.
+  scratch_arena& arena() { return arena_; }
+
+  // Return a copy of setting held by the context, reusing the memory of the
+  // last copy when it is large enough.
+  grid& copy_for_search(const grid& setting) {
+    if (!live_) {
+      live_.emplace(setting);
+      ++reuse_allocations_;
+    } else {
+      size_t before = live_->words().capacity();
+      *live_ = setting;
+      if (live_->words().capacity() != before) {
+        ++reuse_allocations_;
+      }
+    }
+    return *live_;
+  }
+
+  // Return an empty path in the given grid, reusing the memory of the last
+  // one.
+  path& empty_path(const grid& setting) {
+    if (!candidate_) {
+      candidate_.emplace(setting);
+      ++reuse_allocations_;
+    }
+    size_t before = candidate_->steps().capacity();
+    candidate_->reset(setting);
+    if (candidate_->steps().capacity() != before) {
+      ++reuse_allocations_;
+    }
+    return *candidate_;
+  }
+
+  // Return the number of heap allocations the context has made so far,
+  // counting every time the arena, grid, or path had to grow.
+  size_t heap_allocations() const {
+    return arena_.heap_allocations() + reuse_allocations_;
+  }
+};
+
+// Solve the iceberg avoiding problem by dynamic programming, as
+// iceberg_avoiding_dyn_prog does, taking the row of counts from the
+// context's arena. Counts that are not trivially copyable, like
+// big_unsigned, allocate on their own anyway, so they use an ordinary
+// vector.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_dyn_prog(const grid& setting, const Policy& policy,
+                          solver_context& context) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  using value = typename Policy::value_type;
+  if constexpr (std::is_trivially_copyable<value>::value) {
+    auto fixed = try_common_fixed_shapes<Policy>(setting, [&](const auto& g) {
+      return iceberg_avoiding_dyn_prog(g, policy);
+    });
+    if (fixed) {
+      return *fixed;
+    }
+
+    scratch_arena::scope scope(context.arena());
+    value* counts = context.arena().allocate<value>(setting.columns());
+    std::fill(counts, counts + setting.columns(), policy.zero());
+    counts[0] = policy.one(); // base case
+    for (coordinate i = 0; i < setting.rows(); ++i) {
+      dyn_prog_row(setting.row_words(i), counts, setting.columns(), policy);
+    }
+    return counts[setting.columns() - 1];
+  } else {
+    return dyn_prog_rolling(setting, policy);
+  }
+}
+
+// Solve the iceberg avoiding problem exhaustively, as
+// iceberg_avoiding_exhaustive does. The search keeps its state in fixed-size
+// arrays and never allocates, so the context is not needed; this overload
+// exists so every solver can be called the same way.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_exhaustive(const grid& setting, const Policy& policy,
+                            solver_context&) {
+  return iceberg_avoiding_exhaustive(setting, policy);
+}
+
+// Solve the iceberg avoiding problem by backtracking, as
+// iceberg_avoiding_backtracking does, keeping the pruned copy of the grid
+// and the path in the context.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_backtracking(const grid& setting, const Policy& policy,
+                              bool prune_dead_ends, solver_context& context) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  typename Policy::value_type count_paths = policy.zero();
+
+  const grid* search = &setting;
+  if (prune_dead_ends) {
+    grid& live = context.copy_for_search(setting);
+    if (!remove_dead_ends(live)) {
+      return count_paths;
+    }
+    search = &live;
+  }
+
+  path& candidate = context.empty_path(*search);
+  null_stats stats;
+  backtracking_count(candidate, count_paths, policy, stats);
+  return count_paths;
+}
+
+}
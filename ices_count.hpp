@@ -0,0 +1,281 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_count.hpp
+//
+// Count types for the iceberg avoiding problem.
+//
+// The number of paths grows exponentially with the size of the grid, so the
+// algorithms in ices_algs.hpp are templated on a count policy that decides
+// how counts are stored and added. A policy provides:
+//
+//   value_type                          the type of one count
+//   value_type zero() const             the count 0
+//   value_type one() const              the count 1
+//   void add_to(value_type& sum,
+//               const value_type& addend) const
+//                                       sum += addend, in the policy's
+//                                       arithmetic
+//   value_type multiply(const value_type& a,
+//                       const value_type& b) const
+//                                       a * b, in the policy's arithmetic
+//
+// The policies are:
+//
+//   wrapping_count  unsigned int, wrapping silently on overflow; this is the
+//                   historical behavior of the solvers
+//   checked_count   std::uint64_t, saturating at OVERFLOW_VALUE so overflow
+//                   can be detected after the fact
+//   modular_count   std::uint64_t, arithmetic modulo a caller-supplied
+//                   modulus (normally a prime)
+//   exact_count     big_unsigned, an arbitrary-precision integer
+//
+// The fixed-width policies are constexpr throughout, so the compile-time
+// solvers of ices_fixed.hpp can use them in constant expressions.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ices {
+
+// An arbitrary-precision unsigned integer.
+//
+// The value is stored as little-endian 64-bit limbs with no leading zero
+// limbs, so zero has no limbs at all.
+class big_unsigned {
+public:
+  // Type for one limb.
+  using limb = std::uint64_t;
+
+private:
+  std::vector<limb> limbs_;
+
+  // Remove leading zero limbs so the representation stays canonical.
+  void trim() {
+    while (!limbs_.empty() && (limbs_.back() == 0)) {
+      limbs_.pop_back();
+    }
+  }
+
+public:
+
+  // Create a big_unsigned holding the given value.
+  big_unsigned(std::uint64_t value = 0) {
+    if (value != 0) {
+      limbs_.push_back(value);
+    }
+  }
+
+  // Create a big_unsigned from little-endian limbs. Leading zero limbs are
+  // allowed and dropped.
+  explicit big_unsigned(std::vector<limb> limbs)
+  : limbs_(std::move(limbs)) {
+
+    trim();
+  }
+
+  // Accessors.
+  const std::vector<limb>& limbs() const { return limbs_; }
+  bool is_zero() const { return limbs_.empty(); }
+
+  // Add another value to this one.
+  big_unsigned& operator+=(const big_unsigned& o) {
+    if (limbs_.size() < o.limbs_.size()) {
+      limbs_.resize(o.limbs_.size(), 0);
+    }
+    limb carry = 0;
+    size_t i = 0;
+    for (; i < o.limbs_.size(); ++i) {
+      limb sum;
+      limb c1 = __builtin_add_overflow(limbs_[i], o.limbs_[i], &sum);
+      limb c2 = __builtin_add_overflow(sum, carry, &limbs_[i]);
+      carry = c1 | c2;
+    }
+    for (; carry && (i < limbs_.size()); ++i) {
+      carry = __builtin_add_overflow(limbs_[i], carry, &limbs_[i]);
+    }
+    if (carry) {
+      limbs_.push_back(carry);
+    }
+    return *this;
+  }
+
+  // Return the product of two values.
+  friend big_unsigned operator*(const big_unsigned& a, const big_unsigned& b) {
+    big_unsigned product;
+    if (a.is_zero() || b.is_zero()) {
+      return product;
+    }
+    product.limbs_.assign(a.limbs_.size() + b.limbs_.size(), 0);
+    for (size_t i = 0; i < a.limbs_.size(); ++i) {
+      limb carry = 0;
+      for (size_t j = 0; j < b.limbs_.size(); ++j) {
+        unsigned __int128 current =
+          (unsigned __int128)a.limbs_[i] * b.limbs_[j] +
+          product.limbs_[i + j] + carry;
+        product.limbs_[i + j] = limb(current);
+        carry = limb(current >> 64);
+      }
+      product.limbs_[i + b.limbs_.size()] = carry;
+    }
+    product.trim();
+    return product;
+  }
+
+  // Return the remainder of dividing by divisor, replacing this value with
+  // the quotient. divisor must be positive.
+  std::uint64_t divide_small(std::uint64_t divisor) {
+    assert(divisor > 0);
+    unsigned __int128 remainder = 0;
+    for (size_t i = limbs_.size(); i-- > 0; ) {
+      unsigned __int128 current = (remainder << 64) | limbs_[i];
+      limbs_[i] = limb(current / divisor);
+      remainder = current % divisor;
+    }
+    trim();
+    return std::uint64_t(remainder);
+  }
+
+  // Return the decimal representation of this value.
+  std::string to_string() const {
+    if (is_zero()) {
+      return "0";
+    }
+    // Peel off 19 decimal digits at a time, the most that fit in a limb.
+    const std::uint64_t CHUNK = 10000000000000000000ULL;
+    big_unsigned rest = *this;
+    std::vector<std::uint64_t> chunks;
+    while (!rest.is_zero()) {
+      chunks.push_back(rest.divide_small(CHUNK));
+    }
+    std::string result = std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0; ) {
+      std::string digits = std::to_string(chunks[i]);
+      result += std::string(19 - digits.size(), '0') + digits;
+    }
+    return result;
+  }
+
+  // Comparison operators.
+  bool operator==(const big_unsigned& o) const { return limbs_ == o.limbs_; }
+  bool operator!=(const big_unsigned& o) const { return limbs_ != o.limbs_; }
+  bool operator<(const big_unsigned& o) const {
+    if (limbs_.size() != o.limbs_.size()) {
+      return limbs_.size() < o.limbs_.size();
+    }
+    return std::lexicographical_compare(limbs_.rbegin(), limbs_.rend(),
+                                        o.limbs_.rbegin(), o.limbs_.rend());
+  }
+};
+
+// Print a big_unsigned in decimal.
+inline std::ostream& operator<<(std::ostream& out, const big_unsigned& value) {
+  return out << value.to_string();
+}
+
+// Count policy for unsigned int counts that wrap silently on overflow.
+struct wrapping_count {
+  using value_type = unsigned int;
+
+  constexpr value_type zero() const { return 0; }
+  constexpr value_type one() const { return 1; }
+  constexpr void add_to(value_type& sum, const value_type& addend) const {
+    sum += addend;
+  }
+  constexpr value_type multiply(value_type a, value_type b) const {
+    return a * b;
+  }
+};
+
+// Count policy for 64-bit counts that saturate on overflow.
+//
+// Once a count overflows it sticks at OVERFLOW_VALUE, and every count that
+// includes it does too, so a final result of OVERFLOW_VALUE means the true
+// count is at least that large. Use overflowed() to test a result.
+struct checked_count {
+  using value_type = std::uint64_t;
+
+  static constexpr value_type OVERFLOW_VALUE =
+    std::numeric_limits<value_type>::max();
+
+  constexpr value_type zero() const { return 0; }
+  constexpr value_type one() const { return 1; }
+  constexpr void add_to(value_type& sum, const value_type& addend) const {
+    if (__builtin_add_overflow(sum, addend, &sum)) {
+      sum = OVERFLOW_VALUE;
+    }
+  }
+  constexpr value_type multiply(value_type a, value_type b) const {
+    value_type product = 0;
+    if (__builtin_mul_overflow(a, b, &product)) {
+      return OVERFLOW_VALUE;
+    }
+    return product;
+  }
+
+  // Return true if the given count overflowed.
+  static constexpr bool overflowed(value_type count) {
+    return count == OVERFLOW_VALUE;
+  }
+};
+
+// Count policy for 64-bit counts modulo a caller-supplied modulus.
+//
+// The modulus must be at least 2 and at most 2^63, so the sum of two
+// reduced counts never wraps.
+class modular_count {
+public:
+  using value_type = std::uint64_t;
+
+private:
+  value_type modulus_;
+
+public:
+
+  // Create a policy for arithmetic modulo the given modulus.
+  constexpr explicit modular_count(value_type modulus)
+  : modulus_(modulus) {
+
+    assert(modulus >= 2);
+    assert(modulus <= (value_type(1) << 63));
+  }
+
+  // Accessor.
+  constexpr value_type modulus() const { return modulus_; }
+
+  constexpr value_type zero() const { return 0; }
+  constexpr value_type one() const { return 1; }
+  constexpr void add_to(value_type& sum, const value_type& addend) const {
+    sum += addend;
+    if (sum >= modulus_) {
+      sum -= modulus_;
+    }
+  }
+  constexpr value_type multiply(value_type a, value_type b) const {
+    return value_type((unsigned __int128)a * b % modulus_);
+  }
+};
+
+// Count policy for exact, arbitrary-precision counts.
+struct exact_count {
+  using value_type = big_unsigned;
+
+  value_type zero() const { return big_unsigned(); }
+  value_type one() const { return big_unsigned(1); }
+  void add_to(value_type& sum, const value_type& addend) const {
+    sum += addend;
+  }
+  value_type multiply(const value_type& a, const value_type& b) const {
+    return a * b;
+  }
+};
+
+}
@@ -0,0 +1,311 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_fixed.hpp
+//
+// Grids whose shape is fixed at compile time, and solvers specialized for
+// them.
+//
+// With the shape known, the solvers keep their counts in std::array rather
+// than on the heap, every loop bound is a constant the compiler can unroll,
+// and everything is constexpr, so a chart known at compile time can be
+// solved and checked with static_assert. The runtime solvers in
+// ices_algs.hpp dispatch to these automatically for the shapes listed in
+// try_fixed_shapes.
+//
+// This file builds on ices_types.hpp, ices_count.hpp, and ices_stats.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#include "ices_count.hpp"
+#include "ices_stats.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// A grid with Rows rows and Columns columns, packed exactly as grid is, so
+// its row_words can be used with the row kernels of ices_algs.hpp.
+template <coordinate Rows, coordinate Columns>
+class fixed_grid {
+  static_assert((Rows > 0) && (Columns > 0), "grid must be non-empty");
+
+public:
+  using word = grid::word;
+
+  // Number of words in each row.
+  static constexpr coordinate WORDS_PER_ROW = grid::words_for_columns(Columns);
+
+private:
+  std::array<word, Rows * WORDS_PER_ROW> words_;
+
+public:
+
+  // Create a grid holding only CELL_WATER.
+  constexpr fixed_grid() : words_{} { }
+
+  // Create a grid from Rows lines of text in the format of grid::print,
+  // '.' for CELL_WATER and 'X' for CELL_ICEBERG, each Columns long.
+  constexpr explicit fixed_grid(const char* const (&lines)[Rows])
+  : words_{} {
+    for (coordinate r = 0; r < Rows; ++r) {
+      for (coordinate c = 0; c < Columns; ++c) {
+        assert((lines[r][c] == '.') || (lines[r][c] == 'X'));
+        if (lines[r][c] == 'X') {
+          set(r, c, CELL_ICEBERG);
+        }
+      }
+      assert(lines[r][Columns] == '\0');
+    }
+  }
+
+  // Create a copy of a grid, which must have Rows rows and Columns
+  // columns.
+  explicit fixed_grid(const grid& setting)
+  : words_{} {
+    assert((setting.rows() == Rows) && (setting.columns() == Columns));
+    std::copy(setting.words().begin(), setting.words().end(), words_.begin());
+  }
+
+  // Accessors.
+  static constexpr coordinate rows() { return Rows; }
+  static constexpr coordinate columns() { return Columns; }
+  static constexpr coordinate words_per_row() { return WORDS_PER_ROW; }
+
+  // Return a pointer to the packed words of the given row.
+  constexpr const word* row_words(coordinate row) const {
+    assert(row < Rows);
+    return words_.data() + row * WORDS_PER_ROW;
+  }
+
+  // Return the cell at the given row and column.
+  constexpr cell_kind get(coordinate row, coordinate column) const {
+    assert((row < Rows) && (column < Columns));
+    return ((words_[row * WORDS_PER_ROW + column / grid::WORD_BITS] >>
+             (column % grid::WORD_BITS)) & 1) ? CELL_ICEBERG : CELL_WATER;
+  }
+
+  // Set the contents of the cell at the given row and column, as
+  // grid::set.
+  constexpr void set(coordinate row, coordinate column, cell_kind kind) {
+    assert((row < Rows) && (column < Columns));
+    assert(((row != 0) || (column != 0)) || (kind == CELL_WATER));
+
+    word& w = words_[row * WORDS_PER_ROW + column / grid::WORD_BITS];
+    word bit = word(1) << (column % grid::WORD_BITS);
+    if (kind == CELL_ICEBERG) {
+      w |= bit;
+    } else {
+      w &= ~bit;
+    }
+  }
+
+  // Return a copy of this grid as an ordinary grid.
+  grid to_grid() const {
+    grid result(Rows, Columns);
+    for (coordinate r = 0; r < Rows; ++r) {
+      std::copy(row_words(r), row_words(r) + WORDS_PER_ROW,
+                result.row_words(r));
+    }
+    return result;
+  }
+};
+
+// Solve the iceberg avoiding problem for a fixed_grid by dynamic
+// programming, as iceberg_avoiding_dyn_prog does for a grid.
+template <coordinate Rows, coordinate Columns, typename Policy>
+constexpr typename Policy::value_type
+iceberg_avoiding_dyn_prog(const fixed_grid<Rows, Columns>& setting,
+                          const Policy& policy) {
+
+  std::array<typename Policy::value_type, Columns> counts{};
+  for (auto& count : counts) {
+    count = policy.zero();
+  }
+  counts[0] = policy.one(); // base case
+
+  for (coordinate i = 0; i < Rows; ++i) {
+    const grid::word* ice = setting.row_words(i);
+#pragma GCC unroll 64
+    for (coordinate j = 0; j < Columns; ++j) {
+      if ((ice[j / grid::WORD_BITS] >> (j % grid::WORD_BITS)) & 1) {
+        counts[j] = policy.zero();
+      } else if (j > 0) {
+        policy.add_to(counts[j], counts[j - 1]);
+      }
+    }
+  }
+  return counts[Columns - 1];
+}
+
+// Fixed-shape dynamic programming with unsigned int counts that wrap on
+// overflow.
+template <coordinate Rows, coordinate Columns>
+constexpr unsigned int
+iceberg_avoiding_dyn_prog(const fixed_grid<Rows, Columns>& setting) {
+  return iceberg_avoiding_dyn_prog(setting, wrapping_count());
+}
+
+// Count the valid candidates of the exhaustive search (see
+// iceberg_avoiding_exhaustive) in the numeric range [first, end), adding
+// them to count_paths. first must itself be a candidate, i.e. have exactly
+// rows-1 one bits among the low rows+columns-2 bits.
+//
+// Candidates are visited in increasing numeric order. Consecutive
+// candidates usually differ only in their last few steps, so the positions
+// along the shared prefix are reused rather than walked again. No memory is
+// allocated per candidate.
+//
+// Candidates whose shared prefix already hits an iceberg are recorded in
+// stats as pruned (see ices_stats.hpp).
+//
+// This is a template over the grid type, so the same loop serves grid and
+// fixed_grid, and constexpr, so with a fixed_grid and null_stats it can run
+// at compile time.
+template <typename Grid, typename Policy, typename Stats>
+constexpr void exhaustive_count_range(const Grid& setting,
+                            std::uint64_t first,
+                            std::uint64_t end,
+                            typename Policy::value_type& count_paths,
+                            const Policy& policy,
+                            Stats& stats) {
+
+  const size_t steps = setting.rows() + setting.columns() - 2;
+  assert(steps < 64);
+  assert(size_t(__builtin_popcountll(first)) == setting.rows() - 1);
+
+  // row[t] and column[t] are the position after step t of the current
+  // candidate, which are valid for every t < valid_steps. When
+  // valid_steps < steps, step valid_steps of the candidate lands on an
+  // iceberg.
+  std::array<coordinate, 64> row{}, column{};
+  size_t valid_steps = 0;
+
+  // first_changed is the first step in which the candidate differs from
+  // the previous one.
+  std::uint64_t bits = first;
+  size_t first_changed = 0;
+  while (bits < end) {
+
+    // If the shared prefix already hit an iceberg, so does this candidate.
+    if (valid_steps < first_changed) {
+      stats.add_pruned(1);
+    } else {
+      stats.add_candidates(1);
+      size_t reused_steps = first_changed;
+      valid_steps = first_changed;
+      coordinate r = 0, c = 0;
+      if (valid_steps > 0) {
+        r = row[valid_steps - 1];
+        c = column[valid_steps - 1];
+      }
+      for (; valid_steps < steps; ++valid_steps) {
+        if ((bits >> (steps - 1 - valid_steps)) & 1) {
+          ++r;
+        } else {
+          ++c;
+        }
+        if (setting.get(r, c) == CELL_ICEBERG) {
+          break;
+        }
+        row[valid_steps] = r;
+        column[valid_steps] = c;
+      }
+      stats.add_cells(std::min(valid_steps + 1, steps) - reused_steps);
+
+      // if candidate never crosses an X cell:
+      if (valid_steps == steps) {
+        // increment total number of paths
+        policy.add_to(count_paths, policy.one());
+      }
+    }
+
+    // Advance to the next bit string with the same number of one bits.
+    if (bits == 0) {
+      break;
+    }
+    std::uint64_t lowest = bits & -bits,
+      ripple = bits + lowest,
+      next = ripple | (((ripple ^ bits) / lowest) >> 2);
+    first_changed = steps - 1 - (63 - __builtin_clzll(bits ^ next));
+    bits = next;
+  }
+}
+
+// exhaustive_count_range without stats.
+template <typename Grid, typename Policy>
+constexpr void exhaustive_count_range(const Grid& setting,
+                            std::uint64_t first,
+                            std::uint64_t end,
+                            typename Policy::value_type& count_paths,
+                            const Policy& policy) {
+  null_stats stats;
+  exhaustive_count_range(setting, first, end, count_paths, policy, stats);
+}
+
+// Solve the iceberg avoiding problem for a fixed_grid by exhaustive search,
+// with the same candidates, order, and prefix reuse as
+// iceberg_avoiding_exhaustive does for a grid.
+template <coordinate Rows, coordinate Columns, typename Policy>
+constexpr typename Policy::value_type
+iceberg_avoiding_exhaustive(const fixed_grid<Rows, Columns>& setting,
+                            const Policy& policy) {
+
+  constexpr size_t steps = Rows + Columns - 2;
+  static_assert(steps < 64, "path must fit in a 64-bit int");
+
+  typename Policy::value_type count_paths = policy.zero();
+  null_stats stats;
+  exhaustive_count_range(setting, (std::uint64_t(1) << (Rows - 1)) - 1,
+                         std::uint64_t(1) << steps, count_paths, policy,
+                         stats);
+  return count_paths;
+}
+
+// Fixed-shape exhaustive search with unsigned int counts that wrap on
+// overflow.
+template <coordinate Rows, coordinate Columns>
+constexpr unsigned int
+iceberg_avoiding_exhaustive(const fixed_grid<Rows, Columns>& setting) {
+  return iceberg_avoiding_exhaustive(setting, wrapping_count());
+}
+
+// A compile-time grid shape.
+template <coordinate Rows, coordinate Columns>
+struct fixed_shape { };
+
+// If setting has one of the given shapes, copy it into a fixed_grid of that
+// shape, pass it to solve, and return the result; otherwise return
+// std::nullopt. solve must accept a fixed_grid of every listed shape.
+template <typename Result, typename Solve, coordinate... Rows,
+          coordinate... Columns>
+std::optional<Result> try_fixed_shapes(const grid& setting, Solve solve,
+                                       fixed_shape<Rows, Columns>...) {
+  std::optional<Result> result;
+  ((((setting.rows() == Rows) && (setting.columns() == Columns)) &&
+    (result = solve(fixed_grid<Rows, Columns>(setting)), true)) || ...);
+  return result;
+}
+
+// The shapes for which the runtime solvers dispatch to the fixed-shape
+// solvers, for policies whose counts are plain integers.
+template <typename Policy, typename Solve>
+std::optional<typename Policy::value_type>
+try_common_fixed_shapes(const grid& setting, Solve solve) {
+  if constexpr (std::is_trivially_copyable<
+                  typename Policy::value_type>::value) {
+    return try_fixed_shapes<typename Policy::value_type>(
+      setting, solve, fixed_shape<8, 8>(), fixed_shape<16, 16>(),
+      fixed_shape<32, 32>());
+  } else {
+    return std::nullopt;
+  }
+}
+
+}
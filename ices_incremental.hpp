@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_incremental.hpp
+//
+// Keeping the solution to the iceberg avoiding problem up to date while the
+// grid changes a few cells at a time.
+//
+// This file builds on ices_algs.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <utility>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Holds a grid together with its full dynamic programming table, and
+// updates the table as cells change.
+//
+// A change at (r, c) can only affect the counts of cells (i, j) with i >= r
+// and j >= c, and in practice usually far fewer: set() walks down from row
+// r, recomputing each row only from the first column whose count changed in
+// the row above, and stopping once it is past the last such column and the
+// counts agree again. A row with no changed counts ends the update. The
+// work is therefore proportional to the number of counts that actually
+// change, plus one cell per row at the boundary.
+template <typename Policy>
+class incremental_solver {
+public:
+  using value_type = typename Policy::value_type;
+
+private:
+  grid setting_;
+  Policy policy_;
+  count_table<value_type> forward_;
+  size_t last_update_cells_;
+
+  // Return the count for (i, j) from its neighbors in forward_.
+  value_type recompute(coordinate i, coordinate j) const {
+    if (setting_.get(i, j) == CELL_ICEBERG) {
+      return policy_.zero();
+    }
+    value_type count = ((i == 0) && (j == 0)) ? policy_.one() : policy_.zero();
+    if (i > 0) {
+      policy_.add_to(count, forward_.get(i - 1, j));
+    }
+    if (j > 0) {
+      policy_.add_to(count, forward_.get(i, j - 1));
+    }
+    return count;
+  }
+
+public:
+
+  // Create a solver for the given grid, which is copied.
+  explicit incremental_solver(const grid& setting,
+                              const Policy& policy = Policy())
+  : setting_(setting),
+    policy_(policy),
+    forward_(iceberg_avoiding_dyn_prog_table(setting, policy)),
+    last_update_cells_(setting.rows() * setting.columns()) { }
+
+  // Accessors.
+  const grid& setting() const { return setting_; }
+  const count_table<value_type>& forward() const { return forward_; }
+
+  // Return the current solution.
+  const value_type& count() const {
+    return forward_.get(setting_.rows() - 1, setting_.columns() - 1);
+  }
+
+  // Return the number of cells recomputed by the last call to set(), or by
+  // the constructor.
+  size_t last_update_cells() const { return last_update_cells_; }
+
+  // Set the contents of the given cell, as grid::set, and update the
+  // solution.
+  void set(coordinate row, coordinate column, cell_kind kind) {
+
+    last_update_cells_ = 0;
+    if (setting_.get(row, column) == kind) {
+      return;
+    }
+    setting_.set(row, column, kind);
+
+    // Counts in the row above may have changed in columns [first, last].
+    // In the first row updated, (row, column) itself changed.
+    coordinate first = column, last = column;
+    for (coordinate i = row; i < setting_.rows(); ++i) {
+      bool any_changed = false;
+      coordinate next_first = 0, next_last = 0;
+      for (coordinate j = first; j < setting_.columns(); ++j) {
+        value_type count = recompute(i, j);
+        ++last_update_cells_;
+        if (count == forward_.get(i, j)) {
+          if (j >= last) {
+            break;
+          }
+          continue;
+        }
+        forward_.get(i, j) = std::move(count);
+        if (!any_changed) {
+          next_first = j;
+          any_changed = true;
+        }
+        next_last = j;
+      }
+      if (!any_changed) {
+        break;
+      }
+      first = next_first;
+      last = next_last;
+    }
+  }
+};
+
+}
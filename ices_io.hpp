@@ -0,0 +1,402 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_io.hpp
+//
+// Reading and writing grids for the iceberg avoiding problem.
+//
+// Two file formats are supported:
+//
+// Text: one line per row, one character per cell, '.' for CELL_WATER and
+// 'X' for CELL_ICEBERG, exactly as produced by grid::print. Every line must
+// have the same length. A trailing '\r' on a line is ignored.
+//
+// Binary: a 32-byte header followed by the packed cells in exactly the
+// in-memory layout of grid (see ices_types.hpp):
+//
+//   offset  size  contents
+//        0     8  magic "ICESGRID"
+//        8     4  format version, currently 1
+//       12     4  reserved, zero
+//       16     8  number of rows
+//       24     8  number of columns
+//       32        rows * words_per_row 64-bit words, row-major
+//
+// All integers are little-endian. Because the cells need no conversion, a
+// binary file can be memory-mapped with mapped_grid and solved in place.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ices_algs.hpp"
+#include "ices_types.hpp"
+
+#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "ices_io.hpp assumes a little-endian host"
+#endif
+
+namespace ices {
+
+// Magic bytes and version of the binary format.
+const char BINARY_GRID_MAGIC[8] = {'I', 'C', 'E', 'S', 'G', 'R', 'I', 'D'};
+const std::uint32_t BINARY_GRID_VERSION = 1;
+
+// Header of the binary format.
+struct binary_grid_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t rows;
+  std::uint64_t columns;
+};
+static_assert(sizeof(binary_grid_header) == 32, "binary header is 32 bytes");
+
+// The largest number of packed words a binary grid may hold, 2^32 words or
+// 32 GiB of cells. Larger headers are rejected before anything is
+// allocated.
+const std::uint64_t MAX_BINARY_GRID_WORDS = std::uint64_t(1) << 32;
+
+// Return the number of packed words of the grid the header describes, or
+// std::nullopt if rows * words_for_columns(columns) overflows or exceeds
+// MAX_BINARY_GRID_WORDS.
+std::optional<std::uint64_t> header_word_count(const binary_grid_header& header) {
+  std::uint64_t words;
+  if (__builtin_mul_overflow(header.rows,
+                             grid::words_for_columns(header.columns), &words) ||
+      (words > MAX_BINARY_GRID_WORDS)) {
+    return std::nullopt;
+  }
+  return words;
+}
+
+// Return true if the header describes a non-empty grid this code can read.
+bool is_valid_header(const binary_grid_header& header) {
+  return (std::memcmp(header.magic, BINARY_GRID_MAGIC, 8) == 0) &&
+         (header.version == BINARY_GRID_VERSION) &&
+         (header.rows > 0) && (header.columns > 0) &&
+         (header.rows <= (std::uint64_t(1) << 40)) &&
+         (header.columns <= (std::uint64_t(1) << 40)) &&
+         header_word_count(header).has_value();
+}
+
+// Return the number of bytes left to read in the stream, or std::nullopt
+// if the stream cannot seek, as with a pipe.
+std::optional<std::uint64_t> remaining_bytes(std::istream& in) {
+  std::istream::pos_type here = in.tellg();
+  if (here == std::istream::pos_type(-1)) {
+    return std::nullopt;
+  }
+  in.seekg(0, std::ios::end);
+  std::istream::pos_type end = in.tellg();
+  in.seekg(here);
+  if ((end == std::istream::pos_type(-1)) || !in) {
+    in.clear();
+    in.seekg(here);
+    return std::nullopt;
+  }
+  return std::uint64_t(end - here);
+}
+
+// Parse a text grid from the given stream. Reading stops at end of file or
+// at the first empty line. Returns std::nullopt when there are no rows,
+// rows differ in length, a character other than '.' or 'X' appears, or
+// (0, 0) is an iceberg.
+//
+// Each line is packed into words as soon as it is read, so only the packed
+// rows are kept, one bit per cell, plus the current line.
+std::optional<grid> read_text_grid(std::istream& in) {
+
+  coordinate columns = 0, rows = 0, words_per_row = 0;
+  std::vector<grid::word> words;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && (line.back() == '\r')) {
+      line.pop_back();
+    }
+    if (line.empty()) {
+      break;
+    }
+    if (rows == 0) {
+      columns = line.size();
+      words_per_row = grid::words_for_columns(columns);
+    } else if (line.size() != columns) {
+      return std::nullopt;
+    }
+    words.resize(words.size() + words_per_row, 0);
+    grid::word* row = words.data() + rows * words_per_row;
+    for (coordinate c = 0; c < columns; ++c) {
+      if (line[c] == 'X') {
+        row[c / grid::WORD_BITS] |= grid::word(1) << (c % grid::WORD_BITS);
+      } else if (line[c] != '.') {
+        return std::nullopt;
+      }
+    }
+    ++rows;
+  }
+  if ((rows == 0) || (words[0] & 1)) {
+    return std::nullopt;
+  }
+  return grid(rows, columns, std::move(words));
+}
+
+// Write a grid in the text format.
+void write_text_grid(std::ostream& out, const grid& setting) {
+  for (auto& line : setting.printable()) {
+    out << line << '\n';
+  }
+}
+
+// Write a grid in the binary format. Returns false if writing failed.
+bool write_binary_grid(std::ostream& out, const grid& setting) {
+  binary_grid_header header;
+  std::memcpy(header.magic, BINARY_GRID_MAGIC, 8);
+  header.version = BINARY_GRID_VERSION;
+  header.reserved = 0;
+  header.rows = setting.rows();
+  header.columns = setting.columns();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(setting.words().data()),
+            setting.words().size() * sizeof(grid::word));
+  return bool(out);
+}
+
+// Read a grid in the binary format. Returns std::nullopt when the header is
+// invalid, the stream ends early, or (0, 0) is an iceberg. Padding bits
+// past the last column are cleared.
+std::optional<grid> read_binary_grid(std::istream& in) {
+
+  binary_grid_header header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      !is_valid_header(header)) {
+    return std::nullopt;
+  }
+
+  // A header can claim far more cells than the stream holds, so nothing is
+  // allocated until the payload is known to be there: a seekable stream
+  // must be long enough, and any other stream is read in chunks, so memory
+  // grows only with the data actually read.
+  const std::uint64_t total = *header_word_count(header);
+  auto remaining = remaining_bytes(in);
+  if (remaining && (*remaining / sizeof(grid::word) < total)) {
+    return std::nullopt;
+  }
+  const std::uint64_t CHUNK_WORDS = std::uint64_t(1) << 20;
+  std::vector<grid::word> words;
+  if (remaining) {
+    words.reserve(total);
+  }
+  while (words.size() < total) {
+    size_t done = words.size();
+    words.resize(done + std::min(CHUNK_WORDS, total - done));
+    if (!in.read(reinterpret_cast<char*>(words.data() + done),
+                 (words.size() - done) * sizeof(grid::word))) {
+      return std::nullopt;
+    }
+  }
+
+  const coordinate per_row = grid::words_for_columns(header.columns),
+    tail = header.columns % grid::WORD_BITS;
+  if (tail != 0) {
+    for (coordinate r = 0; r < header.rows; ++r) {
+      words[r * per_row + per_row - 1] &= (grid::word(1) << tail) - 1;
+    }
+  }
+  if (words[0] & 1) {
+    return std::nullopt;
+  }
+  return grid(header.rows, header.columns, std::move(words));
+}
+
+// Load a grid from a file in either format, recognizing the binary format
+// by its magic bytes. Returns std::nullopt if the file cannot be opened or
+// parsed.
+std::optional<grid> load_grid(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+  char magic[8] = {};
+  in.read(magic, 8);
+  bool binary = in && (std::memcmp(magic, BINARY_GRID_MAGIC, 8) == 0);
+  in.clear();
+  in.seekg(0);
+  return binary ? read_binary_grid(in) : read_text_grid(in);
+}
+
+// Save a grid to a file in the binary format, or the text format when text
+// is true. Returns false if the file cannot be written.
+bool save_grid(const std::string& filename, const grid& setting,
+               bool text = false) {
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) {
+    return false;
+  }
+  if (text) {
+    write_text_grid(out, setting);
+  } else {
+    write_binary_grid(out, setting);
+  }
+  return bool(out);
+}
+
+// A read-only grid backed by a memory-mapped binary grid file.
+//
+// This has the same read accessors as grid, and the cells are never copied:
+// pages are read from the file as the algorithms touch them. Padding bits
+// past the last column are whatever the file holds, so accessors here and
+// the dynamic programming kernels never look at them.
+class mapped_grid {
+private:
+  void* mapping_;
+  size_t length_;
+  coordinate rows_, columns_, words_per_row_;
+  const grid::word* words_;
+
+  mapped_grid(void* mapping, size_t length, const binary_grid_header& header)
+  : mapping_(mapping),
+    length_(length),
+    rows_(header.rows),
+    columns_(header.columns),
+    words_per_row_(grid::words_for_columns(header.columns)),
+    words_(reinterpret_cast<const grid::word*>(
+             static_cast<const char*>(mapping) + sizeof(header))) { }
+
+public:
+
+  // Map the binary grid file with the given name. Returns std::nullopt if
+  // the file cannot be opened or mapped, its header is invalid, it is
+  // shorter than the header says, or (0, 0) is an iceberg.
+  static std::optional<mapped_grid> open(const std::string& filename) {
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    struct stat status;
+    if ((::fstat(fd, &status) != 0) ||
+        (size_t(status.st_size) < sizeof(binary_grid_header))) {
+      ::close(fd);
+      return std::nullopt;
+    }
+    size_t length = status.st_size;
+    void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      return std::nullopt;
+    }
+    ::madvise(mapping, length, MADV_SEQUENTIAL);
+
+    binary_grid_header header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (!is_valid_header(header) ||
+        ((length - sizeof(header)) / sizeof(grid::word) / header.rows <
+         grid::words_for_columns(header.columns))) {
+      ::munmap(mapping, length);
+      return std::nullopt;
+    }
+    mapped_grid result(mapping, length, header);
+    if (!result.may_step(0, 0)) {
+      return std::nullopt;
+    }
+    return result;
+  }
+
+  // Mapped grids are move-only.
+  mapped_grid(const mapped_grid&) = delete;
+  mapped_grid& operator=(const mapped_grid&) = delete;
+  mapped_grid(mapped_grid&& o)
+  : mapping_(o.mapping_),
+    length_(o.length_),
+    rows_(o.rows_),
+    columns_(o.columns_),
+    words_per_row_(o.words_per_row_),
+    words_(o.words_) {
+    o.mapping_ = nullptr;
+  }
+  mapped_grid& operator=(mapped_grid&& o) {
+    std::swap(mapping_, o.mapping_);
+    std::swap(length_, o.length_);
+    rows_ = o.rows_;
+    columns_ = o.columns_;
+    words_per_row_ = o.words_per_row_;
+    words_ = o.words_;
+    return *this;
+  }
+  ~mapped_grid() {
+    if (mapping_ != nullptr) {
+      ::munmap(mapping_, length_);
+    }
+  }
+
+  // Accessors.
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+  coordinate words_per_row() const { return words_per_row_; }
+
+  // Test whether the given value is a valid row or column number.
+  bool is_row(coordinate row) const { return row < rows(); }
+  bool is_column(coordinate column) const { return column < columns(); }
+  bool is_row_column(coordinate row, coordinate column) const {
+    return is_row(row) && is_column(column);
+  }
+
+  // Return a pointer to the words_per_row() packed words of the given row.
+  const grid::word* row_words(coordinate row) const {
+    assert(is_row(row));
+    return words_ + row * words_per_row_;
+  }
+
+  // Return the cell at the given row and column.
+  cell_kind get(coordinate row, coordinate column) const {
+    assert(is_row_column(row, column));
+    return ((row_words(row)[column / grid::WORD_BITS] >>
+             (column % grid::WORD_BITS)) & 1) ? CELL_ICEBERG : CELL_WATER;
+  }
+
+  // Return true if it is valid to step into the given row and column.
+  bool may_step(coordinate row, coordinate column) const {
+    return is_row_column(row, column) && (get(row, column) == CELL_WATER);
+  }
+
+  // Copy the mapped cells into an ordinary grid.
+  grid to_grid() const {
+    grid result(rows_, columns_);
+    const coordinate tail = columns_ % grid::WORD_BITS;
+    for (coordinate r = 0; r < rows_; ++r) {
+      grid::word* row = result.row_words(r);
+      std::copy(row_words(r), row_words(r) + words_per_row_, row);
+      if (tail != 0) {
+        row[words_per_row_ - 1] &= (grid::word(1) << tail) - 1;
+      }
+    }
+    return result;
+  }
+};
+
+// Solve the iceberg avoiding problem directly on a memory-mapped grid, using
+// the rolling-row dynamic programming algorithm of iceberg_avoiding_dyn_prog.
+template <typename Policy>
+typename Policy::value_type iceberg_avoiding_dyn_prog(const mapped_grid& setting,
+                                                      const Policy& policy) {
+  return dyn_prog_rolling(setting, policy);
+}
+unsigned int iceberg_avoiding_dyn_prog(const mapped_grid& setting) {
+  return dyn_prog_rolling(setting, wrapping_count());
+}
+
+}
@@ -0,0 +1,330 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_parallel.hpp
+//
+// Multithreaded algorithms for the iceberg avoiding problem.
+//
+// This file builds on ices_algs.hpp, and produces the same results as the
+// serial algorithms there.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Return the number of threads to use when the caller asked for the given
+// number; 0 means one per hardware thread.
+unsigned resolve_thread_count(unsigned requested) {
+  if (requested > 0) {
+    return requested;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// A reusable barrier for a fixed number of threads.
+class barrier {
+private:
+  std::mutex mutex_;
+  std::condition_variable released_;
+  unsigned threads_, waiting_;
+  unsigned long generation_;
+
+public:
+
+  // Create a barrier for the given number of threads.
+  explicit barrier(unsigned threads)
+  : threads_(threads), waiting_(0), generation_(0) {
+    assert(threads > 0);
+  }
+
+  // Block until all threads have called wait() in this generation.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    unsigned long generation = generation_;
+    if (++waiting_ == threads_) {
+      waiting_ = 0;
+      ++generation_;
+      released_.notify_all();
+    } else {
+      released_.wait(lock, [&]() { return generation != generation_; });
+    }
+  }
+};
+
+// Call task(thread, index) once for every index in [0, tasks), spread
+// across the given number of threads, and return when all calls are done.
+//
+// Each thread starts with a contiguous block of indices in its own queue
+// and works through it in order; a thread whose queue runs dry steals from
+// the far end of another thread's queue, so uneven tasks still keep every
+// thread busy. thread is in [0, threads), and the calling thread is thread
+// 0.
+template <typename Task>
+void work_stealing_for(size_t tasks, unsigned threads, Task task) {
+
+  assert(threads > 0);
+
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<size_t> indices;
+  };
+  std::vector<task_queue> queues(threads);
+  for (unsigned t = 0; t < threads; ++t) {
+    for (size_t i = tasks * t / threads; i < tasks * (t + 1) / threads; ++i) {
+      queues[t].indices.push_back(i);
+    }
+  }
+
+  // Take the next task for thread self, from its own queue if possible.
+  auto take = [&](unsigned self, size_t& index) {
+    for (unsigned k = 0; k < threads; ++k) {
+      task_queue& queue = queues[(self + k) % threads];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.indices.empty()) {
+        if (k == 0) {
+          index = queue.indices.front();
+          queue.indices.pop_front();
+        } else {
+          index = queue.indices.back();
+          queue.indices.pop_back();
+        }
+        return true;
+      }
+    }
+    return false;
+  };
+
+  auto worker = [&](unsigned self) {
+    size_t index;
+    while (take(self, index)) {
+      task(self, index);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t) {
+    pool.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+// Options for the parallel algorithms.
+struct parallel_options {
+  // Number of threads; 0 means one per hardware thread.
+  unsigned threads = 0;
+
+  // Height and width of one dynamic programming tile, in cells.
+  coordinate tile_size = 256;
+
+  // Number of leading steps fixed by each exhaustive search task; 0 picks
+  // enough tasks to keep every thread busy.
+  coordinate prefix_steps = 0;
+};
+
+// Solve the iceberg avoiding problem for the given grid, using dynamic
+// programming spread across several threads.
+//
+// The grid is split into square tiles. A tile depends only on the tile
+// above it and the tile to its left, so all tiles on one anti-diagonal of
+// tiles are independent; threads process one anti-diagonal at a time and
+// meet at a barrier before the next. Tiles exchange boundaries through one
+// row of counts (the bottom row of the tiles above) and one column of
+// counts (the right column of the tiles to the left), so memory is
+// O(rows + columns).
+//
+// The result is identical to iceberg_avoiding_dyn_prog with the same count
+// policy.
+//
+// The grid must be non-empty.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_dyn_prog_parallel(const grid& setting,
+                                   const parallel_options& options,
+                                   const Policy& policy) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+  assert(options.tile_size > 0);
+
+  using count = typename Policy::value_type;
+
+  const coordinate rows = setting.rows(), columns = setting.columns(),
+    tile = options.tile_size,
+    tile_rows = (rows + tile - 1) / tile,
+    tile_columns = (columns + tile - 1) / tile,
+    diagonals = tile_rows + tile_columns - 1;
+
+  std::vector<count> edge_row(columns, policy.zero()),
+    edge_column(rows, policy.zero());
+  edge_row[0] = policy.one(); // base case
+
+  auto solve_tile = [&](coordinate tile_row, coordinate tile_column) {
+    coordinate row_begin = tile_row * tile,
+      row_end = std::min(rows, row_begin + tile),
+      column_begin = tile_column * tile,
+      column_end = std::min(columns, column_begin + tile);
+    for (coordinate i = row_begin; i < row_end; ++i) {
+      dyn_prog_row_segment(setting.row_words(i), edge_row.data(),
+                           column_begin, column_end, edge_column[i], policy);
+      edge_column[i] = edge_row[column_end - 1];
+    }
+  };
+
+  const unsigned threads = std::min<coordinate>(
+    resolve_thread_count(options.threads), std::min(tile_rows, tile_columns));
+
+  if (threads <= 1) {
+    for (coordinate d = 0; d < diagonals; ++d) {
+      coordinate first = (d >= tile_columns) ? d - tile_columns + 1 : 0,
+        last = std::min(d, tile_rows - 1);
+      for (coordinate tile_row = first; tile_row <= last; ++tile_row) {
+        solve_tile(tile_row, d - tile_row);
+      }
+    }
+    return edge_row.back();
+  }
+
+  // One claim counter per anti-diagonal, so no counter needs resetting
+  // between barriers.
+  std::unique_ptr<std::atomic<coordinate>[]>
+    next_tile(new std::atomic<coordinate>[diagonals]);
+  for (coordinate d = 0; d < diagonals; ++d) {
+    next_tile[d] = (d >= tile_columns) ? d - tile_columns + 1 : 0;
+  }
+  barrier diagonal_done(threads);
+
+  auto worker = [&]() {
+    for (coordinate d = 0; d < diagonals; ++d) {
+      coordinate last = std::min(d, tile_rows - 1);
+      for (coordinate tile_row = next_tile[d]++; tile_row <= last;
+           tile_row = next_tile[d]++) {
+        solve_tile(tile_row, d - tile_row);
+      }
+      diagonal_done.wait();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : pool) {
+    thread.join();
+  }
+  return edge_row.back();
+}
+
+// Parallel dynamic programming with unsigned int counts that wrap on
+// overflow.
+unsigned int
+iceberg_avoiding_dyn_prog_parallel(const grid& setting,
+                                   const parallel_options& options =
+                                     parallel_options()) {
+  return iceberg_avoiding_dyn_prog_parallel(setting, options, wrapping_count());
+}
+
+// Solve the iceberg avoiding problem for the given grid, using the
+// exhaustive search of iceberg_avoiding_exhaustive spread across several
+// threads.
+//
+// The candidate bit strings are partitioned by their first prefix_steps
+// steps; each feasible prefix is one task, covering the contiguous numeric
+// range of candidates that start with it. Tasks are spread with
+// work_stealing_for, each thread sums its own count, and the per-thread
+// counts are added in thread order, so the result is identical to
+// iceberg_avoiding_exhaustive with the same count policy.
+//
+// The grid must be non-empty, and width+height must fit in a 64-bit int.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_exhaustive_parallel(const grid& setting,
+                                     const parallel_options& options,
+                                     const Policy& policy) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  // Compute the path length, and check that it is legal.
+  const coordinate steps = setting.rows() + setting.columns() - 2,
+    downs = setting.rows() - 1,
+    rights = setting.columns() - 1;
+  assert(steps < 64);
+
+  const unsigned threads = resolve_thread_count(options.threads);
+
+  // Aim for about 64 tasks per thread unless told otherwise.
+  coordinate prefix_steps = options.prefix_steps;
+  if (prefix_steps == 0) {
+    while ((prefix_steps < steps) &&
+           ((coordinate(1) << prefix_steps) < 64 * coordinate(threads))) {
+      ++prefix_steps;
+    }
+  }
+  prefix_steps = std::min(prefix_steps, steps);
+
+  // Keep only the prefixes that some candidate starts with.
+  std::vector<std::uint64_t> prefixes;
+  for (std::uint64_t prefix = 0; prefix < (std::uint64_t(1) << prefix_steps);
+       ++prefix) {
+    coordinate prefix_downs = __builtin_popcountll(prefix);
+    if ((prefix_downs <= downs) &&
+        (prefix_steps - prefix_downs <= rights)) {
+      prefixes.push_back(prefix);
+    }
+  }
+
+  const coordinate suffix_steps = steps - prefix_steps;
+  std::vector<typename Policy::value_type> partial(threads, policy.zero());
+
+  work_stealing_for(prefixes.size(), threads, [&](unsigned thread,
+                                                  size_t index) {
+    std::uint64_t prefix = prefixes[index];
+    coordinate suffix_downs = downs - __builtin_popcountll(prefix);
+    typename Policy::value_type count = policy.zero();
+    exhaustive_count_range(setting,
+                           (prefix << suffix_steps) |
+                             ((std::uint64_t(1) << suffix_downs) - 1),
+                           (prefix + 1) << suffix_steps,
+                           count, policy);
+    policy.add_to(partial[thread], count);
+  });
+
+  typename Policy::value_type count_paths = policy.zero();
+  for (auto& count : partial) {
+    policy.add_to(count_paths, count);
+  }
+  return count_paths;
+}
+
+// Parallel exhaustive search with unsigned int counts that wrap on
+// overflow.
+unsigned int
+iceberg_avoiding_exhaustive_parallel(const grid& setting,
+                                     const parallel_options& options =
+                                       parallel_options()) {
+  return iceberg_avoiding_exhaustive_parallel(setting, options,
+                                              wrapping_count());
+}
+
+}
@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_paths.hpp
+//
+// Producing actual paths, rather than counts, for the iceberg avoiding
+// problem: enumerating every path lazily, and drawing paths uniformly at
+// random.
+//
+// This file builds on ices_algs.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Produces the paths of a grid one at a time, in lexicographic order with
+// right steps before down steps, without ever holding more than the current
+// path.
+//
+// The search runs on a copy of the grid with its dead ends turned into
+// icebergs (see without_dead_ends), so every prefix it extends leads to a
+// path, and each call to next() takes O(rows + columns) steps.
+class path_generator {
+private:
+  const grid* setting_;
+  std::unique_ptr<grid> live_;
+  std::unique_ptr<path> current_;
+  bool started_;
+
+  // Extend current_ to the goal, preferring right steps.
+  void descend() {
+    const coordinate goal_row = live_->rows() - 1,
+      goal_column = live_->columns() - 1;
+    while ((current_->final_row() != goal_row) ||
+           (current_->final_column() != goal_column)) {
+      if (current_->is_step_valid(STEP_DIRECTION_RIGHT)) {
+        current_->add_step(STEP_DIRECTION_RIGHT);
+      } else {
+        assert(current_->is_step_valid(STEP_DIRECTION_DOWN));
+        current_->add_step(STEP_DIRECTION_DOWN);
+      }
+    }
+  }
+
+public:
+
+  // Create a generator for the paths of the given grid, which must outlive
+  // the generator and the paths it produces.
+  explicit path_generator(const grid& setting)
+  : setting_(&setting), started_(false) {
+    auto live = without_dead_ends(setting);
+    if (live) {
+      live_.reset(new grid(std::move(*live)));
+      current_.reset(new path(*live_));
+    }
+  }
+
+  // Return the next path, or std::nullopt once every path has been
+  // produced.
+  std::optional<path> next() {
+    if (!current_) {
+      return std::nullopt;
+    }
+    if (!started_) {
+      started_ = true;
+    } else {
+      // Back up to the last right step that could have been a down step.
+      while (true) {
+        if (current_->steps().size() == 1) {
+          current_.reset();
+          return std::nullopt;
+        }
+        step_direction last = current_->last_step().direction();
+        current_->remove_last_step();
+        if ((last == STEP_DIRECTION_RIGHT) &&
+            current_->is_step_valid(STEP_DIRECTION_DOWN)) {
+          current_->add_step(STEP_DIRECTION_DOWN);
+          break;
+        }
+      }
+    }
+    descend();
+
+    std::vector<step_direction> directions;
+    directions.reserve(current_->steps().size() - 1);
+    for (size_t i = 1; i < current_->steps().size(); ++i) {
+      directions.push_back(current_->steps()[i].direction());
+    }
+    return path(*setting_, directions);
+  }
+};
+
+// Draws paths of a grid uniformly at random.
+//
+// The constructor runs the backward dynamic programming recurrence (see
+// iceberg_avoiding_backward_table) once, and stores for each cell the
+// probability that a uniformly random path through that cell continues to
+// the right: backward(r, c+1) / backward(r, c). Counts are kept as doubles
+// rescaled after each row, which leaves the ratios within a row unchanged
+// while keeping them in range on any size of grid, so sampling is uniform
+// up to double rounding. Each sample then takes O(rows + columns) time.
+class path_sampler {
+private:
+  const grid* setting_;
+  std::vector<double> right_probability_;
+  bool has_paths_;
+
+public:
+
+  // Create a sampler for the given grid, which must outlive the sampler and
+  // the paths it produces. This takes O(rows * columns) time and memory.
+  explicit path_sampler(const grid& setting)
+  : setting_(&setting),
+    right_probability_(setting.rows() * setting.columns(), 0.0),
+    has_paths_(false) {
+
+    const coordinate rows = setting.rows(), columns = setting.columns();
+
+    // below holds the rescaled counts of the row below, and current those
+    // of the row being computed.
+    std::vector<double> below(columns, 0.0), current(columns, 0.0);
+    for (coordinate i = rows; i-- > 0; ) {
+      double from_right = 0.0, largest = 0.0;
+      for (coordinate j = columns; j-- > 0; ) {
+        double count = 0.0;
+        if (setting.get(i, j) != CELL_ICEBERG) {
+          bool is_goal = (i == rows - 1) && (j == columns - 1);
+          count = (is_goal ? 1.0 : below[j]) + from_right;
+          if (count > 0.0) {
+            right_probability_[i * columns + j] = from_right / count;
+          }
+        }
+        current[j] = from_right = count;
+        largest = std::max(largest, count);
+      }
+      if (largest > 0.0) {
+        for (auto& count : current) {
+          count /= largest;
+        }
+      }
+      std::swap(below, current);
+    }
+    has_paths_ = (below[0] > 0.0);
+  }
+
+  // Return true if the grid has at least one path.
+  bool has_paths() const { return has_paths_; }
+
+  // Return a uniformly random path. The grid must have at least one path.
+  template <typename URNG>
+  path sample(URNG&& gen) const {
+    path result(*setting_);
+    walk(gen, result);
+    return result;
+  }
+
+  // Return a uniformly random path as a compact_path, which is cheaper to
+  // build and keep when drawing many samples. The grid must have at least
+  // one path.
+  template <typename URNG>
+  compact_path sample_compact(URNG&& gen) const {
+    compact_path result;
+    result.reserve(setting_->rows() + setting_->columns() - 2);
+    walk(gen, result);
+    return result;
+  }
+
+private:
+  // Extend result, which is at (0, 0), to the goal with random steps.
+  // Route is path or compact_path.
+  template <typename URNG, typename Route>
+  void walk(URNG& gen, Route& result) const {
+    assert(has_paths_);
+
+    const coordinate goal_row = setting_->rows() - 1,
+      goal_column = setting_->columns() - 1;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    while ((result.final_row() != goal_row) ||
+           (result.final_column() != goal_column)) {
+      double p = right_probability_[result.final_row() * setting_->columns() +
+                                    result.final_column()];
+      result.add_step((uniform(gen) < p) ? STEP_DIRECTION_RIGHT
+                                          : STEP_DIRECTION_DOWN);
+    }
+  }
+};
+
+}
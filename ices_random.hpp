@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_random.hpp
+//
+// Generating large random grids quickly.
+//
+// grid::random places an exact number of icebergs one at a time, which is
+// O(icebergs). For benchmark charts with billions of cells it is faster to
+// give every cell the same chance of being an iceberg and produce the
+// packed words directly, 64 cells at a time and on several threads, which
+// is what random_grid_with_density does.
+//
+// This file builds on ices_types.hpp and the thread helpers of
+// ices_parallel.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+#include "ices_parallel.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// The SplitMix64 generator: a 64-bit state advanced by a constant and
+// scrambled on output. It is tiny, fast, passes BigCrush, and is
+// splittable: split() and stream() derive generators whose outputs are, for
+// practical purposes, independent of their parent's, so each thread or row
+// can have its own. It satisfies UniformRandomBitGenerator, so it can also
+// be passed to grid::random.
+class splitmix64 {
+private:
+  std::uint64_t state_;
+
+  // The SplitMix64 output function.
+  static std::uint64_t mix(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+public:
+  using result_type = std::uint64_t;
+
+  // Create a generator with the given seed.
+  explicit splitmix64(std::uint64_t seed = 0) : state_(seed) { }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  // Return the next 64 random bits.
+  result_type operator()() {
+    state_ += 0x9E3779B97F4A7C15ULL;
+    return mix(state_);
+  }
+
+  // Return a new generator seeded from this one, advancing this one.
+  splitmix64 split() { return splitmix64((*this)()); }
+
+  // Return generator number index of the family identified by seed. The
+  // same seed and index always give the same generator, regardless of the
+  // order in which generators are created.
+  static splitmix64 stream(std::uint64_t seed, std::uint64_t index) {
+    return splitmix64(mix(seed ^ mix(index + 0x9E3779B97F4A7C15ULL)));
+  }
+};
+
+// Return a word in which each bit is set independently with probability
+// numerator / 2^32.
+//
+// Writing p = numerator / 2^32 in binary as 0.b1 b2 ... b32, the word starts
+// at zero and, for each bit from b32 up to b1, is ORed with a fresh random
+// word when the bit is 1 and ANDed with one when it is 0. Each step halves
+// the probability and adds b_i / 2, so after the last step every bit is set
+// with probability exactly p. Trailing zero bits of p are skipped, so
+// densities such as 1/2 or 1/8 take only a word or a few.
+std::uint64_t bernoulli_word(splitmix64& gen, std::uint64_t numerator) {
+  assert(numerator <= (std::uint64_t(1) << 32));
+  if (numerator == (std::uint64_t(1) << 32)) {
+    return ~std::uint64_t(0);
+  }
+  std::uint64_t word = 0;
+  if (numerator == 0) {
+    return word;
+  }
+  for (int bit = __builtin_ctzll(numerator); bit < 32; ++bit) {
+    if ((numerator >> bit) & 1) {
+      word |= gen();
+    } else {
+      word &= gen();
+    }
+  }
+  return word;
+}
+
+// Create a random grid in which each cell other than (0, 0) and
+// (rows-1, columns-1) is an iceberg independently with probability density,
+// rounded to a multiple of 2^-32.
+//
+// Each row draws from its own splitmix64::stream(seed, row), so the grid
+// depends only on the shape, density, and seed, not on the number of
+// threads. Rows are generated in parallel by threads threads (0 for one per
+// hardware thread). Memory is just the grid, and time is proportional to
+// rows * columns / 64 times the number of significant bits of density.
+grid random_grid_with_density(coordinate rows, coordinate columns,
+                              double density, std::uint64_t seed,
+                              unsigned threads = 1) {
+
+  assert(rows > 0);
+  assert(columns > 0);
+  assert((density >= 0.0) && (density <= 1.0));
+
+  const std::uint64_t numerator =
+    std::uint64_t(density * double(std::uint64_t(1) << 32) + 0.5);
+  const coordinate words = grid::words_for_columns(columns);
+  const coordinate used = columns % grid::WORD_BITS;
+  const grid::word last_mask = used ? (grid::word(1) << used) - 1
+                                    : ~grid::word(0);
+
+  grid result(rows, columns);
+
+  // Rows are handed out in blocks so each task does a useful amount of
+  // work even on narrow grids.
+  const coordinate ROWS_PER_TASK =
+    std::max<coordinate>(1, 65536 / (words * grid::WORD_BITS));
+  const coordinate tasks = (rows + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+  auto fill = [&](unsigned, size_t task) {
+    coordinate end = std::min(rows, (task + 1) * ROWS_PER_TASK);
+    for (coordinate r = task * ROWS_PER_TASK; r < end; ++r) {
+      splitmix64 gen = splitmix64::stream(seed, r);
+      grid::word* row = result.row_words(r);
+      for (coordinate k = 0; k < words; ++k) {
+        row[k] = bernoulli_word(gen, numerator);
+      }
+      row[words - 1] &= last_mask;
+    }
+  };
+  threads = std::min<coordinate>(resolve_thread_count(threads), tasks);
+  if (threads <= 1) {
+    for (size_t task = 0; task < tasks; ++task) {
+      fill(0, task);
+    }
+  } else {
+    work_stealing_for(tasks, threads, fill);
+  }
+
+  result.set(0, 0, CELL_WATER);
+  result.set(rows - 1, columns - 1, CELL_WATER);
+  return result;
+}
+
+}
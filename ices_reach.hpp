@@ -0,0 +1,220 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_reach.hpp
+//
+// Bit-parallel reachability for the iceberg avoiding problem.
+//
+// Whether a cell can be reached at all needs one bit per cell rather than
+// one count, so a whole word of cells is handled with a few integer
+// operations. That decides whether any path exists in O(rows * columns /
+// 64) time, and finds the cells that lie on some path, so counting can skip
+// the rest of the grid.
+//
+// This file builds on ices_algs.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Return the mask of the bits of the last word of a row that hold cells.
+grid::word last_word_mask(coordinate columns) {
+  coordinate used = columns % grid::WORD_BITS;
+  return used ? (grid::word(1) << used) - 1 : ~grid::word(0);
+}
+
+// Extend reachability rightward along one row.
+//
+// ice points to the words words of the row, as returned by grid::row_words.
+// On entry reach holds the seed cells, and on exit every water cell that
+// can be reached from a water seed by right steps through water. Within a
+// word, adding the seeds to the water mask carries from each seed through
+// the rest of its run of water, so ((water + seeds) ^ water) & water marks
+// the reached cells past the first seed of each run; a run that reaches
+// the top bit carries into the next word.
+void reach_right(const grid::word* ice, grid::word* reach, coordinate words,
+                 grid::word last_mask) {
+  grid::word carry = 0;
+  for (coordinate k = 0; k < words; ++k) {
+    grid::word water = ~ice[k] & ((k + 1 == words) ? last_mask : ~grid::word(0));
+    grid::word seeds = (reach[k] | carry) & water;
+    reach[k] = (((water + seeds) ^ water) & water) | seeds;
+    carry = reach[k] >> (grid::WORD_BITS - 1);
+  }
+}
+
+// Extend reachability leftward along one row, the mirror image of
+// reach_right: on exit reach holds every water cell from which a water seed
+// can be reached by right steps through water. There is no borrow trick to
+// match the carry of reach_right, so each word is filled with six doubling
+// shift-and-mask steps.
+void reach_left(const grid::word* ice, grid::word* reach, coordinate words,
+                grid::word last_mask) {
+  grid::word carry = 0;
+  for (coordinate k = words; k-- > 0; ) {
+    grid::word water = ~ice[k] & ((k + 1 == words) ? last_mask : ~grid::word(0));
+    grid::word x = (reach[k] | (carry << (grid::WORD_BITS - 1))) & water;
+    // open has bit j set when cells j through j + shift - 1 are all water.
+    grid::word open = water;
+    for (unsigned shift = 1; shift < grid::WORD_BITS; shift *= 2) {
+      x |= open & (x >> shift);
+      open &= open >> shift;
+    }
+    reach[k] = x;
+    carry = x & 1;
+  }
+}
+
+// Return true if the given grid has at least one path from (0, 0) to
+// (rows-1, columns-1). This takes O(rows * columns / 64) time and
+// O(columns / 64) memory, and stops early at a row no path reaches.
+bool path_exists(const grid& setting) {
+
+  const coordinate words = setting.words_per_row();
+  const grid::word last_mask = last_word_mask(setting.columns());
+
+  // reach starts as the row "above" row 0, entering (0, 0); after each row
+  // it holds the cells of that row reachable from (0, 0), which are also
+  // the seeds of the next row.
+  std::vector<grid::word> reach(words, 0);
+  reach[0] = 1;
+  for (coordinate i = 0; i < setting.rows(); ++i) {
+    reach_right(setting.row_words(i), reach.data(), words, last_mask);
+    if (std::all_of(reach.begin(), reach.end(),
+                    [](grid::word w) { return w == 0; })) {
+      return false;
+    }
+  }
+  coordinate goal = setting.columns() - 1;
+  return (reach[goal / grid::WORD_BITS] >> (goal % grid::WORD_BITS)) & 1;
+}
+
+// Return a copy of the given grid in which every cell that is not on some
+// path from (0, 0) to (rows-1, columns-1) is an iceberg, or std::nullopt
+// if there is no path. Unlike without_dead_ends, this also removes cells
+// that cannot be reached from (0, 0).
+//
+// A forward pass marks the cells reachable from (0, 0), a backward pass the
+// cells that can reach the goal, and a cell is on a path exactly when it is
+// both. This takes O(rows * columns / 64) time.
+std::optional<grid> live_cells(const grid& setting) {
+
+  const coordinate rows = setting.rows(), words = setting.words_per_row();
+  const grid::word last_mask = last_word_mask(setting.columns());
+
+  // The forward pass stores the reachable cells in the rows of result.
+  grid result(rows, setting.columns());
+  std::vector<grid::word> reach(words, 0);
+  reach[0] = 1;
+  for (coordinate i = 0; i < rows; ++i) {
+    reach_right(setting.row_words(i), reach.data(), words, last_mask);
+    if (std::all_of(reach.begin(), reach.end(),
+                    [](grid::word w) { return w == 0; })) {
+      return std::nullopt;
+    }
+    std::copy(reach.begin(), reach.end(), result.row_words(i));
+  }
+  coordinate goal = setting.columns() - 1;
+  grid::word goal_bit = grid::word(1) << (goal % grid::WORD_BITS);
+  if (!(reach[goal / grid::WORD_BITS] & goal_bit)) {
+    return std::nullopt;
+  }
+
+  // The backward pass turns each row of result into its icebergs: cells
+  // that are not both forward and backward reachable. back starts as the
+  // row "below" the last row, leaving the goal.
+  std::vector<grid::word> back(words, 0);
+  back[goal / grid::WORD_BITS] = goal_bit;
+  for (coordinate i = rows; i-- > 0; ) {
+    reach_left(setting.row_words(i), back.data(), words, last_mask);
+    grid::word* row = result.row_words(i);
+    for (coordinate k = 0; k < words; ++k) {
+      grid::word mask = (k + 1 == words) ? last_mask : ~grid::word(0);
+      row[k] = ~(row[k] & back[k]) & mask;
+    }
+  }
+  assert(result.get(0, 0) == CELL_WATER);
+  return result;
+}
+
+// Return the first and last water columns of the given row, which must
+// have at least one.
+void water_span(const grid& setting, coordinate row,
+                coordinate& first, coordinate& last) {
+  const grid::word* ice = setting.row_words(row);
+  const coordinate words = setting.words_per_row();
+  const grid::word last_mask = last_word_mask(setting.columns());
+
+  coordinate k = 0;
+  grid::word water = 0;
+  for (; k < words; ++k) {
+    water = ~ice[k] & ((k + 1 == words) ? last_mask : ~grid::word(0));
+    if (water) {
+      break;
+    }
+  }
+  assert(k < words);
+  first = k * grid::WORD_BITS + __builtin_ctzll(water);
+
+  for (k = words; k-- > 0; ) {
+    water = ~ice[k] & ((k + 1 == words) ? last_mask : ~grid::word(0));
+    if (water) {
+      break;
+    }
+  }
+  last = k * grid::WORD_BITS + (grid::WORD_BITS - 1 - __builtin_clzll(water));
+}
+
+// Solve the iceberg avoiding problem by dynamic programming restricted to
+// the cells that lie on some path.
+//
+// live_cells decides first, in O(rows * columns / 64) time, whether there
+// is any path at all, returning zero at once if not. Otherwise the counts
+// of each row are computed only between its first and last live columns.
+// Those spans only move right from one row to the next, so counts left of
+// a span are never read again and counts right of it are still zero. On
+// heavily iced grids this skips most of the counting work; on open grids
+// it costs one extra bit-parallel pass and a copy of the grid.
+//
+// The grid must be non-empty.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_dyn_prog_live(const grid& setting, const Policy& policy) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  auto live = live_cells(setting);
+  if (!live) {
+    return policy.zero();
+  }
+
+  std::vector<typename Policy::value_type> counts(setting.columns(),
+                                                  policy.zero());
+  counts[0] = policy.one(); // base case
+  for (coordinate i = 0; i < setting.rows(); ++i) {
+    coordinate first, last;
+    water_span(*live, i, first, last);
+    dyn_prog_row_segment(live->row_words(i), counts.data(), first, last + 1,
+                         policy.zero(), policy);
+  }
+  return counts.back();
+}
+
+// Live-region dynamic programming with unsigned int counts that wrap on
+// overflow.
+unsigned int iceberg_avoiding_dyn_prog_live(const grid& setting) {
+  return iceberg_avoiding_dyn_prog_live(setting, wrapping_count());
+}
+
+}
@@ -0,0 +1,340 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_rle.hpp
+//
+// Run-length encoded grids for mostly open charts.
+//
+// A chart of long water runs broken by a few ice fields is described by its
+// ice runs far more compactly than by one bit per cell. rle_grid stores
+// each row as a sorted list of maximal runs of icebergs, so memory is
+// proportional to the number of runs, and offers the same read API as grid.
+// Its dynamic programming handles a run at a time: each ice run clears its
+// counts at once, each water run is a plain prefix sum with no per-cell ice
+// tests, and columns left of every path are never touched.
+//
+// This file builds on ices_types.hpp and ices_count.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// A run of icebergs in one row, from column first to column last inclusive.
+struct ice_run {
+  coordinate first, last;
+
+  bool operator==(const ice_run& o) const {
+    return (first == o.first) && (last == o.last);
+  }
+  bool operator!=(const ice_run& o) const { return !(*this == o); }
+};
+
+// A grid stored as the ice runs of each row.
+//
+// The runs of all rows are kept in one vector, in row-major order, with
+// the runs of each row sorted, disjoint, and never adjacent, so every grid
+// has exactly one representation. Runs are added in row-major order, which
+// suits charts read or generated a row at a time.
+class rle_grid {
+private:
+  coordinate rows_, columns_;
+  std::vector<ice_run> runs_;
+  // row_start_[r] is the index of the first run of row r, for rows up to
+  // last_row_; later rows have no runs yet.
+  std::vector<size_t> row_start_;
+  coordinate last_row_;
+
+  // Return the index one past the last run of the given row.
+  size_t row_end(coordinate row) const {
+    return (row < last_row_) ? row_start_[row + 1] : runs_.size();
+  }
+
+  // Return the index of the first run of the given row.
+  size_t row_begin(coordinate row) const {
+    return (row <= last_row_) ? row_start_[row] : runs_.size();
+  }
+
+  // Return the first run of the given row that ends at or after column, or
+  // the end of the row's runs if there is none.
+  const ice_run* run_at_or_after(coordinate row, coordinate column) const {
+    return std::lower_bound(row_runs(row), row_runs(row) + row_run_count(row),
+                            column, [](const ice_run& run, coordinate c) {
+                              return run.last < c;
+                            });
+  }
+
+public:
+
+  // Create a grid with the given number of rows and columns, all
+  // initialized to hold CELL_WATER.
+  rle_grid(coordinate rows, coordinate columns)
+  : rows_(rows), columns_(columns), row_start_(rows, 0), last_row_(0) {
+
+    assert(rows > 0);
+    assert(columns > 0);
+  }
+
+  // Create a copy of a grid. This finds each run with a pair of
+  // count-trailing-zeros steps, so it takes O(rows * columns / 64 + runs)
+  // time.
+  explicit rle_grid(const grid& setting)
+  : rle_grid(setting.rows(), setting.columns()) {
+
+    const coordinate words = setting.words_per_row();
+    for (coordinate r = 0; r < rows_; ++r) {
+      const grid::word* ice = setting.row_words(r);
+
+      // Return the first column at or after c whose bit is value, or
+      // columns_ if there is none. Padding bits are zero, so a search for
+      // water always stops by the end of the last word.
+      auto next = [&](coordinate c, bool value) {
+        for (coordinate k = c / grid::WORD_BITS; k < words; ++k) {
+          grid::word w = value ? ice[k] : ~ice[k];
+          if (k == c / grid::WORD_BITS) {
+            w &= ~grid::word(0) << (c % grid::WORD_BITS);
+          }
+          if (w != 0) {
+            return std::min(columns_,
+                            k * grid::WORD_BITS + __builtin_ctzll(w));
+          }
+        }
+        return columns_;
+      };
+
+      for (coordinate c = next(0, true); c < columns_; ) {
+        coordinate end = next(c, false);
+        add_ice_run(r, c, end - 1);
+        c = (end < columns_) ? next(end, true) : columns_;
+      }
+    }
+  }
+
+  // Accessors.
+  coordinate rows() const { return rows_; }
+  coordinate columns() const { return columns_; }
+  size_t run_count() const { return runs_.size(); }
+
+  // Test whether the given value is a valid row or column number.
+  bool is_row(coordinate row) const { return row < rows(); }
+  bool is_column(coordinate column) const { return column < columns(); }
+  bool is_row_column(coordinate row, coordinate column) const {
+    return is_row(row) && is_column(column);
+  }
+
+  // Return a pointer to the row_run_count(row) ice runs of the given row,
+  // sorted by column.
+  const ice_run* row_runs(coordinate row) const {
+    assert(is_row(row));
+    return runs_.data() + row_begin(row);
+  }
+  size_t row_run_count(coordinate row) const {
+    assert(is_row(row));
+    return row_end(row) - row_begin(row);
+  }
+
+  // Make the cells from first to last, inclusive, of the given row
+  // CELL_ICEBERG. Runs must be added in row-major order: row must be no
+  // earlier than the row of the last run added, and within a row first must
+  // be past the last run added. A run touching the previous one is merged
+  // with it. (0, 0) may only be CELL_WATER.
+  void add_ice_run(coordinate row, coordinate first, coordinate last) {
+    assert(is_row(row));
+    assert(first <= last);
+    assert(is_column(last));
+    assert((row != 0) || (first != 0));
+    assert(row >= last_row_);
+
+    for (coordinate r = last_row_ + 1; r <= row; ++r) {
+      row_start_[r] = runs_.size();
+    }
+    last_row_ = row;
+
+    if (row_run_count(row) > 0) {
+      ice_run& previous = runs_.back();
+      assert(first > previous.last);
+      if (first == previous.last + 1) {
+        previous.last = last;
+        return;
+      }
+    }
+    runs_.push_back({first, last});
+  }
+
+  // Return the cell at the given row and column. This is a binary search
+  // of the row's runs.
+  cell_kind get(coordinate row, coordinate column) const {
+    assert(is_row_column(row, column));
+    const ice_run* run = run_at_or_after(row, column);
+    return ((run != row_runs(row) + row_run_count(row)) &&
+            (run->first <= column)) ? CELL_ICEBERG : CELL_WATER;
+  }
+
+  // Return true if the cells from first to last, inclusive, of the given
+  // row are all CELL_WATER.
+  bool is_water_run(coordinate row, coordinate first, coordinate last) const {
+    assert(is_row(row));
+    assert(first <= last);
+    assert(is_column(last));
+    const ice_run* run = run_at_or_after(row, first);
+    return (run == row_runs(row) + row_run_count(row)) || (run->first > last);
+  }
+
+  // Return true if it is valid to step into the given row and column, as
+  // grid::may_step.
+  bool may_step(coordinate row, coordinate column) const {
+    return is_row_column(row, column) && (get(row, column) == CELL_WATER);
+  }
+
+  // Equality operator; grids are equal when they have the same shape and
+  // the same cells.
+  bool operator==(const rle_grid& o) const {
+    if ((rows_ != o.rows_) || (columns_ != o.columns_) || (runs_ != o.runs_)) {
+      return false;
+    }
+    for (coordinate r = 0; r < rows_; ++r) {
+      if (row_run_count(r) != o.row_run_count(r)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator!=(const rle_grid& o) const { return !(*this == o); }
+
+  // Return strings corresponding to lines of text in a human-readable
+  // representation of the grid.
+  std::vector<std::string> printable() const {
+    std::vector<std::string> result(rows(), std::string(columns(), '.'));
+    for (coordinate r = 0; r < rows(); ++r) {
+      for (size_t i = 0; i < row_run_count(r); ++i) {
+        const ice_run& run = row_runs(r)[i];
+        std::fill(result[r].begin() + run.first,
+                  result[r].begin() + run.last + 1, 'X');
+      }
+    }
+    return result;
+  }
+
+  // Print the grid.
+  void print() const {
+    for (auto& line : printable()) {
+      std::cout << line << std::endl;
+    }
+  }
+
+  // Return a copy of this grid as an ordinary grid.
+  grid to_grid() const {
+    grid result(rows_, columns_);
+    for (coordinate r = 0; r < rows_; ++r) {
+      for (size_t i = 0; i < row_run_count(r); ++i) {
+        const ice_run& run = row_runs(r)[i];
+        for (coordinate c = run.first; c <= run.last; ++c) {
+          result.set(r, c, CELL_ICEBERG);
+        }
+      }
+    }
+    return result;
+  }
+};
+
+// Replace counts[j] with counts[begin] + ... + counts[j] for each j from
+// begin + 1 to end - 1, the dynamic programming over a run of water.
+//
+// For plain integer counts the running sum is kept in a local, along with a
+// local copy of the policy, so the compiler can see that neither aliases
+// counts and the loop carries its sum in a register rather than through
+// memory, about three times faster for modular_count.
+template <typename Policy>
+void water_prefix_sum(typename Policy::value_type* counts,
+                      coordinate begin, coordinate end,
+                      const Policy& policy) {
+  using value = typename Policy::value_type;
+  if constexpr (std::is_trivially_copyable<value>::value) {
+    const Policy local_policy = policy;
+    value sum = counts[begin];
+    for (coordinate j = begin + 1; j < end; ++j) {
+      local_policy.add_to(sum, counts[j]);
+      counts[j] = sum;
+    }
+  } else {
+    for (coordinate j = begin + 1; j < end; ++j) {
+      policy.add_to(counts[j], counts[j - 1]);
+    }
+  }
+}
+
+// Solve the iceberg avoiding problem for a run-length encoded grid by
+// dynamic programming, with the same results as iceberg_avoiding_dyn_prog
+// for the equivalent grid.
+//
+// Each ice run sets its counts to zero with one fill, and each water run is
+// a prefix sum: its first cell has ice or the edge to its left, so it keeps
+// the count from above, and every later cell adds its left neighbor. No
+// path ever moves left, so the counts left of the first column a path can
+// reach stay zero and are skipped, and once an ice run covers every column
+// a path could reach, the answer is zero at once.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_dyn_prog(const rle_grid& setting, const Policy& policy) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  const coordinate columns = setting.columns();
+  std::vector<typename Policy::value_type> counts(columns, policy.zero());
+  counts[0] = policy.one(); // base case
+
+  // Every count left of column lo is zero.
+  coordinate lo = 0;
+  for (coordinate i = 0; i < setting.rows(); ++i) {
+    const ice_run* run = setting.row_runs(i);
+    const ice_run* end = run + setting.row_run_count(i);
+    while ((run != end) && (run->last < lo)) {
+      ++run;
+    }
+    if ((run != end) && (run->first <= lo)) {
+      std::fill(counts.begin() + lo, counts.begin() + run->last + 1,
+                policy.zero());
+      lo = run->last + 1;
+      ++run;
+      if (lo == columns) {
+        return policy.zero();
+      }
+    }
+
+    // Alternate water runs and ice runs from lo to the end of the row.
+    for (coordinate j = lo; ; ) {
+      coordinate water_end = (run != end) ? run->first : columns;
+      water_prefix_sum(counts.data(), j, water_end, policy);
+      if (run == end) {
+        break;
+      }
+      std::fill(counts.begin() + run->first, counts.begin() + run->last + 1,
+                policy.zero());
+      j = run->last + 1;
+      ++run;
+      if (j == columns) {
+        break;
+      }
+    }
+  }
+  return counts.back();
+}
+
+// Run-length dynamic programming with unsigned int counts that wrap on
+// overflow.
+unsigned int iceberg_avoiding_dyn_prog(const rle_grid& setting) {
+  return iceberg_avoiding_dyn_prog(setting, wrapping_count());
+}
+
+}
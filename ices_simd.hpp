@@ -0,0 +1,564 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_simd.hpp
+//
+// Vectorized kernels for the iceberg avoiding problem.
+//
+// The kernels use x86 SSE4.1 and AVX2 intrinsics through GCC target
+// attributes, so this file compiles without any -m flags and picks a code
+// path at run time. On other architectures only the scalar path exists.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ICES_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#include "ices_algs.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Instruction set levels that the vectorized kernels may use.
+enum simd_level { SIMD_SCALAR, SIMD_SSE4, SIMD_AVX2 };
+
+// Return the best instruction set level supported by this CPU.
+simd_level detect_simd_level() {
+#ifdef ICES_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return SIMD_SSE4;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+// Return true if kernels at the given level can run on this CPU.
+bool simd_level_supported(simd_level level) {
+  return level <= detect_simd_level();
+}
+
+// Return 32 ice bits of the given row, starting at column start, which may
+// be negative. Bit b of the result is the cell at column start + b; cells
+// outside the grid read as water.
+std::uint32_t ice_window(const grid& setting, coordinate row,
+                         std::ptrdiff_t start) {
+
+  if (!setting.is_row(row)) {
+    return 0;
+  }
+  const grid::word* words = setting.row_words(row);
+  const std::ptrdiff_t WORD = grid::WORD_BITS,
+    total = WORD * std::ptrdiff_t(setting.words_per_row());
+
+  if ((start <= -WORD) || (start >= total)) {
+    return 0;
+  }
+  if (start < 0) {
+    return std::uint32_t(words[0] << -start);
+  }
+  std::ptrdiff_t index = start / WORD, offset = start % WORD;
+  grid::word bits = words[index] >> offset;
+  if ((offset != 0) && (index + 1 < total / WORD)) {
+    bits |= words[index + 1] << (WORD - offset);
+  }
+  return std::uint32_t(bits);
+}
+
+// The wavefront kernels below sweep the grid in horizontal strips of
+// STRIP_ROWS rows. Within a strip, step k holds the anti-diagonal of cells
+// (r0 + l, k - l) for every lane l, packed into vector registers: each
+// lane's left neighbor is its own value from step k - 1, and its upper
+// neighbor is the next lower lane's value from step k - 1, so one step is a
+// lane rotate, an add, and a blend that zeroes the icebergs. The top lane
+// reads the row above the strip from bottom, and the bottom lane writes the
+// strip's last row back into bottom for the next strip.
+//
+// Lanes that fall off the left, right or bottom edge of the grid hold
+// values that never flow back into a cell of the grid.
+const coordinate STRIP_ROWS = 32;
+
+#ifdef ICES_SIMD_X86
+
+__attribute__((target("avx2")))
+unsigned int wavefront_strips_avx2(const grid& setting) {
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  const int VECTORS = STRIP_ROWS / 8;
+
+  std::vector<unsigned int> bottom(columns, 0);
+  bottom[0] = 1; // base case
+  unsigned int result = 0;
+
+  const __m256i rotate = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (coordinate r0 = 0; r0 < rows; r0 += STRIP_ROWS) {
+    const coordinate steps = columns + STRIP_ROWS - 1;
+    const bool last_strip = (r0 + STRIP_ROWS >= rows);
+    const coordinate answer_lane = rows - 1 - r0,
+      answer_step = columns - 1 + answer_lane;
+
+    __m256i v[VECTORS], ice[VECTORS];
+    for (int q = 0; q < VECTORS; ++q) {
+      v[q] = zero;
+      ice[q] = zero;
+    }
+
+    for (coordinate k = 0; k < steps; ++k) {
+      if (k % 32 == 0) {
+        for (int q = 0; q < VECTORS; ++q) {
+          std::uint32_t w[8];
+          for (int l = 0; l < 8; ++l) {
+            std::ptrdiff_t lane = 8 * q + l;
+            w[l] = ice_window(setting, r0 + lane, std::ptrdiff_t(k) - lane);
+          }
+          ice[q] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w));
+        }
+      }
+
+      __m256i rotated[VECTORS];
+      for (int q = 0; q < VECTORS; ++q) {
+        rotated[q] = _mm256_permutevar8x32_epi32(v[q], rotate);
+      }
+      __m256i above = _mm256_set1_epi32(int(k < columns ? bottom[k] : 0));
+      for (int q = 0; q < VECTORS; ++q) {
+        __m256i shifted =
+          _mm256_blend_epi32(rotated[q], (q == 0) ? above : rotated[q - 1], 1);
+        __m256i sum = _mm256_add_epi32(v[q], shifted);
+        __m256 is_ice = _mm256_castsi256_ps(_mm256_slli_epi32(ice[q], 31));
+        v[q] = _mm256_castps_si256(
+          _mm256_blendv_ps(_mm256_castsi256_ps(sum),
+                           _mm256_castsi256_ps(zero), is_ice));
+        ice[q] = _mm256_srli_epi32(ice[q], 1);
+      }
+
+      if ((k >= STRIP_ROWS - 1) && (k - (STRIP_ROWS - 1) < columns)) {
+        bottom[k - (STRIP_ROWS - 1)] =
+          unsigned(_mm256_extract_epi32(v[VECTORS - 1], 7));
+      }
+      if (last_strip && (k == answer_step)) {
+        unsigned int lanes[STRIP_ROWS];
+        for (int q = 0; q < VECTORS; ++q) {
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + 8 * q), v[q]);
+        }
+        result = lanes[answer_lane];
+      }
+    }
+  }
+  return result;
+}
+
+__attribute__((target("sse4.1")))
+unsigned int wavefront_strips_sse4(const grid& setting) {
+
+  const coordinate rows = setting.rows(), columns = setting.columns();
+  const int VECTORS = STRIP_ROWS / 4;
+
+  std::vector<unsigned int> bottom(columns, 0);
+  bottom[0] = 1; // base case
+  unsigned int result = 0;
+
+  const __m128i zero = _mm_setzero_si128();
+
+  for (coordinate r0 = 0; r0 < rows; r0 += STRIP_ROWS) {
+    const coordinate steps = columns + STRIP_ROWS - 1;
+    const bool last_strip = (r0 + STRIP_ROWS >= rows);
+    const coordinate answer_lane = rows - 1 - r0,
+      answer_step = columns - 1 + answer_lane;
+
+    __m128i v[VECTORS], ice[VECTORS];
+    for (int q = 0; q < VECTORS; ++q) {
+      v[q] = zero;
+      ice[q] = zero;
+    }
+
+    for (coordinate k = 0; k < steps; ++k) {
+      if (k % 32 == 0) {
+        for (int q = 0; q < VECTORS; ++q) {
+          std::uint32_t w[4];
+          for (int l = 0; l < 4; ++l) {
+            std::ptrdiff_t lane = 4 * q + l;
+            w[l] = ice_window(setting, r0 + lane, std::ptrdiff_t(k) - lane);
+          }
+          ice[q] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+        }
+      }
+
+      __m128i rotated[VECTORS];
+      for (int q = 0; q < VECTORS; ++q) {
+        rotated[q] = _mm_shuffle_epi32(v[q], _MM_SHUFFLE(2, 1, 0, 3));
+      }
+      __m128i above = _mm_set1_epi32(int(k < columns ? bottom[k] : 0));
+      for (int q = 0; q < VECTORS; ++q) {
+        __m128i shifted =
+          _mm_blend_epi16(rotated[q], (q == 0) ? above : rotated[q - 1], 0x03);
+        __m128i sum = _mm_add_epi32(v[q], shifted);
+        __m128 is_ice = _mm_castsi128_ps(_mm_slli_epi32(ice[q], 31));
+        v[q] = _mm_castps_si128(
+          _mm_blendv_ps(_mm_castsi128_ps(sum), _mm_castsi128_ps(zero), is_ice));
+        ice[q] = _mm_srli_epi32(ice[q], 1);
+      }
+
+      if ((k >= STRIP_ROWS - 1) && (k - (STRIP_ROWS - 1) < columns)) {
+        bottom[k - (STRIP_ROWS - 1)] =
+          unsigned(_mm_extract_epi32(v[VECTORS - 1], 3));
+      }
+      if (last_strip && (k == answer_step)) {
+        unsigned int lanes[STRIP_ROWS];
+        for (int q = 0; q < VECTORS; ++q) {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4 * q), v[q]);
+        }
+        result = lanes[answer_lane];
+      }
+    }
+  }
+  return result;
+}
+
+#endif
+
+// Solve the iceberg avoiding problem with an anti-diagonal wavefront
+// kernel, using unsigned int counts that wrap on overflow exactly like
+// iceberg_avoiding_dyn_prog.
+//
+// level selects the code path, and defaults to the best one this CPU
+// supports; SIMD_SCALAR falls back to the row-major dynamic programming
+// loop. The requested level must be supported.
+//
+// The grid must be non-empty.
+unsigned int iceberg_avoiding_wavefront(const grid& setting,
+                                        simd_level level = detect_simd_level()) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  assert(simd_level_supported(level));
+
+#ifdef ICES_SIMD_X86
+  if (level == SIMD_AVX2) {
+    return wavefront_strips_avx2(setting);
+  }
+  if (level == SIMD_SSE4) {
+    return wavefront_strips_sse4(setting);
+  }
+#endif
+  return iceberg_avoiding_dyn_prog(setting);
+}
+
+// The scan kernels below compute one row of the row-major dynamic
+// programming algorithm as a segmented prefix sum. Within a row,
+//
+//   counts[j] = ice(j) ? 0 : counts[j] + counts[j - 1],
+//
+// so each count is the sum of the counts above it back to the nearest
+// iceberg on its left, which is an inclusive scan of the row above with a
+// new segment starting at every iceberg. Each vector of columns is loaded
+// from the row, its icebergs zeroed and turned into segment flags, and
+// scanned in registers with the usual log-step shift-and-add, where a lane
+// stops adding once its flag is set and flags spread along with the sums.
+// The last count of the previous vector is then added to every lane not
+// cut off by a flag. The only dependence from one vector to the next is
+// that carry, so the counts stream through in row-major order instead of
+// waiting one add per cell.
+
+#ifdef ICES_SIMD_X86
+
+// Shift the lanes of v up by the given number of lanes, filling the low
+// lanes with zeros.
+__attribute__((target("avx2")))
+__m256i shift_lanes_avx2(__m256i v, int lanes) {
+  const __m256i index = _mm256_sub_epi32(
+    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(lanes));
+  return _mm256_andnot_si256(
+    _mm256_cmpgt_epi32(_mm256_setzero_si256(), index),
+    _mm256_permutevar8x32_epi32(v, index));
+}
+
+// Scan one vector of eight counts in place, with no icebergs: shift up by
+// 1, 2 and 4 lanes and add, then add carry, the previous vector's last
+// count in every lane.
+__attribute__((target("avx2")))
+__m256i water_scan_avx2(__m256i v, __m256i carry) {
+  v = _mm256_add_epi32(v, shift_lanes_avx2(v, 1));
+  v = _mm256_add_epi32(v, shift_lanes_avx2(v, 2));
+  v = _mm256_add_epi32(v, shift_lanes_avx2(v, 4));
+  return _mm256_add_epi32(v, carry);
+}
+
+// Scan one vector of eight counts in place, where flag has the lanes
+// holding icebergs set and those counts already zero. The flags are
+// shifted along with the counts, and a lane stops adding once it has seen
+// a flag.
+__attribute__((target("avx2")))
+__m256i segmented_scan_avx2(__m256i v, __m256i flag, __m256i carry) {
+  v = _mm256_add_epi32(v, _mm256_andnot_si256(flag, shift_lanes_avx2(v, 1)));
+  flag = _mm256_or_si256(flag, shift_lanes_avx2(flag, 1));
+  v = _mm256_add_epi32(v, _mm256_andnot_si256(flag, shift_lanes_avx2(v, 2)));
+  flag = _mm256_or_si256(flag, shift_lanes_avx2(flag, 2));
+  v = _mm256_add_epi32(v, _mm256_andnot_si256(flag, shift_lanes_avx2(v, 4)));
+  flag = _mm256_or_si256(flag, shift_lanes_avx2(flag, 4));
+  return _mm256_add_epi32(v, _mm256_andnot_si256(flag, carry));
+}
+
+__attribute__((target("avx2")))
+void dyn_prog_row_scan_avx2(const grid::word* ice, unsigned int* counts,
+                            coordinate columns) {
+
+  const __m256i lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128),
+    last = _mm256_set1_epi32(7);
+
+  __m256i carry = _mm256_setzero_si256();
+  coordinate j = 0;
+  while (j + 8 <= columns) {
+    grid::word w = ice[j / grid::WORD_BITS];
+    __m256i* cell = reinterpret_cast<__m256i*>(counts + j);
+    if ((w == 0) && (j + grid::WORD_BITS <= columns)) {
+      // A whole word of water needs no flags.
+      for (int q = 0; q < 8; ++q) {
+        __m256i v = water_scan_avx2(_mm256_loadu_si256(cell + q), carry);
+        _mm256_storeu_si256(cell + q, v);
+        carry = _mm256_permutevar8x32_epi32(v, last);
+      }
+      j += grid::WORD_BITS;
+      continue;
+    }
+    int bits = int((w >> (j % grid::WORD_BITS)) & 0xFF);
+    __m256i flag = _mm256_cmpeq_epi32(
+      _mm256_and_si256(_mm256_set1_epi32(bits), lane_bit), lane_bit);
+    __m256i v = segmented_scan_avx2(
+      _mm256_andnot_si256(flag, _mm256_loadu_si256(cell)), flag, carry);
+    _mm256_storeu_si256(cell, v);
+    carry = _mm256_permutevar8x32_epi32(v, last);
+    j += 8;
+  }
+
+  unsigned int left = unsigned(_mm256_cvtsi256_si32(carry));
+  for (; j < columns; ++j) {
+    if ((ice[j / grid::WORD_BITS] >> (j % grid::WORD_BITS)) & 1) {
+      counts[j] = 0;
+    } else {
+      counts[j] += left;
+    }
+    left = counts[j];
+  }
+}
+
+__attribute__((target("sse4.1")))
+void dyn_prog_row_scan_sse4(const grid::word* ice, unsigned int* counts,
+                            coordinate columns) {
+
+  const __m128i lane_bit = _mm_setr_epi32(1, 2, 4, 8);
+
+  __m128i carry = _mm_setzero_si128();
+  coordinate j = 0;
+  for (; j + 4 <= columns; j += 4) {
+    int bits = int((ice[j / grid::WORD_BITS] >> (j % grid::WORD_BITS)) & 0xF);
+    __m128i flag = _mm_cmpeq_epi32(
+      _mm_and_si128(_mm_set1_epi32(bits), lane_bit), lane_bit);
+    __m128i v = _mm_andnot_si128(
+      flag, _mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + j)));
+
+    // Byte shifts fill the low lanes with zeros, which are neither counts
+    // nor flags.
+    v = _mm_add_epi32(v, _mm_andnot_si128(flag, _mm_slli_si128(v, 4)));
+    flag = _mm_or_si128(flag, _mm_slli_si128(flag, 4));
+    v = _mm_add_epi32(v, _mm_andnot_si128(flag, _mm_slli_si128(v, 8)));
+    flag = _mm_or_si128(flag, _mm_slli_si128(flag, 8));
+
+    v = _mm_add_epi32(v, _mm_andnot_si128(flag, carry));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(counts + j), v);
+    carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+
+  unsigned int left = unsigned(_mm_cvtsi128_si32(carry));
+  for (; j < columns; ++j) {
+    if ((ice[j / grid::WORD_BITS] >> (j % grid::WORD_BITS)) & 1) {
+      counts[j] = 0;
+    } else {
+      counts[j] += left;
+    }
+    left = counts[j];
+  }
+}
+
+#endif
+
+// Advance one whole row of the dynamic programming algorithm in place, as
+// dyn_prog_row does with wrapping_count, using the segmented scan kernel
+// for the given level. The level must be supported.
+void dyn_prog_row_scan(const grid::word* ice, unsigned int* counts,
+                       coordinate columns, simd_level level) {
+#ifdef ICES_SIMD_X86
+  if (level == SIMD_AVX2) {
+    dyn_prog_row_scan_avx2(ice, counts, columns);
+    return;
+  }
+  if (level == SIMD_SSE4) {
+    dyn_prog_row_scan_sse4(ice, counts, columns);
+    return;
+  }
+#endif
+  dyn_prog_row(ice, counts, columns, wrapping_count());
+}
+
+// Solve the iceberg avoiding problem by row-major dynamic programming with
+// the segmented scan row kernel, using unsigned int counts that wrap on
+// overflow exactly like iceberg_avoiding_dyn_prog.
+//
+// level selects the code path, and defaults to the best one this CPU
+// supports; SIMD_SCALAR uses the scalar row loop. The requested level must
+// be supported.
+//
+// The grid must be non-empty.
+unsigned int iceberg_avoiding_dyn_prog_scan(
+    const grid& setting, simd_level level = detect_simd_level()) {
+
+  // grid must be non-empty.
+  assert(setting.rows() > 0);
+  assert(setting.columns() > 0);
+
+  assert(simd_level_supported(level));
+
+  std::vector<unsigned int> counts(setting.columns(), 0);
+  counts[0] = 1; // base case
+  for (coordinate i = 0; i < setting.rows(); ++i) {
+    dyn_prog_row_scan(setting.row_words(i), counts.data(), setting.columns(),
+                      level);
+  }
+  return counts.back();
+}
+
+// Return the number of grids iceberg_avoiding_dyn_prog_lanes solves at once
+// at the given level.
+coordinate simd_lane_count(simd_level level) {
+  switch (level) {
+  case SIMD_AVX2:
+    return 8;
+  case SIMD_SSE4:
+    return 4;
+  default:
+    return 1;
+  }
+}
+
+// The lane kernels below run the row-major dynamic programming algorithm on
+// several grids of the same shape at once, one grid per vector lane. scratch
+// holds one row of counts with the lanes of each column interleaved, and
+// each lane's ice bits are fed in 32 columns at a time and consumed with a
+// shift and a sign-bit blend, as in the wavefront kernels.
+
+#ifdef ICES_SIMD_X86
+
+__attribute__((target("avx2")))
+void dyn_prog_lanes_avx2(const grid* const* settings, unsigned int* results,
+                         std::vector<unsigned int>& scratch) {
+
+  const coordinate rows = settings[0]->rows(),
+    columns = settings[0]->columns();
+  const __m256i zero = _mm256_setzero_si256();
+
+  scratch.assign(columns * 8, 0);
+  std::fill(scratch.begin(), scratch.begin() + 8, 1); // base case
+
+  for (coordinate i = 0; i < rows; ++i) {
+    __m256i left = zero, ice = zero;
+    for (coordinate j = 0; j < columns; ++j) {
+      if (j % 32 == 0) {
+        std::uint32_t w[8];
+        for (int l = 0; l < 8; ++l) {
+          w[l] = ice_window(*settings[l], i, j);
+        }
+        ice = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w));
+      }
+      __m256i* cell = reinterpret_cast<__m256i*>(scratch.data() + 8 * j);
+      __m256i sum = _mm256_add_epi32(_mm256_loadu_si256(cell), left);
+      __m256 is_ice = _mm256_castsi256_ps(_mm256_slli_epi32(ice, 31));
+      left = _mm256_castps_si256(
+        _mm256_blendv_ps(_mm256_castsi256_ps(sum),
+                         _mm256_castsi256_ps(zero), is_ice));
+      _mm256_storeu_si256(cell, left);
+      ice = _mm256_srli_epi32(ice, 1);
+    }
+  }
+  std::copy(scratch.end() - 8, scratch.end(), results);
+}
+
+__attribute__((target("sse4.1")))
+void dyn_prog_lanes_sse4(const grid* const* settings, unsigned int* results,
+                         std::vector<unsigned int>& scratch) {
+
+  const coordinate rows = settings[0]->rows(),
+    columns = settings[0]->columns();
+  const __m128i zero = _mm_setzero_si128();
+
+  scratch.assign(columns * 4, 0);
+  std::fill(scratch.begin(), scratch.begin() + 4, 1); // base case
+
+  for (coordinate i = 0; i < rows; ++i) {
+    __m128i left = zero, ice = zero;
+    for (coordinate j = 0; j < columns; ++j) {
+      if (j % 32 == 0) {
+        std::uint32_t w[4];
+        for (int l = 0; l < 4; ++l) {
+          w[l] = ice_window(*settings[l], i, j);
+        }
+        ice = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+      }
+      __m128i* cell = reinterpret_cast<__m128i*>(scratch.data() + 4 * j);
+      __m128i sum = _mm_add_epi32(_mm_loadu_si128(cell), left);
+      __m128 is_ice = _mm_castsi128_ps(_mm_slli_epi32(ice, 31));
+      left = _mm_castps_si128(
+        _mm_blendv_ps(_mm_castsi128_ps(sum), _mm_castsi128_ps(zero), is_ice));
+      _mm_storeu_si128(cell, left);
+      ice = _mm_srli_epi32(ice, 1);
+    }
+  }
+  std::copy(scratch.end() - 4, scratch.end(), results);
+}
+
+#endif
+
+// Solve simd_lane_count(level) grids of identical shape at once, storing
+// the solution for settings[l] in results[l]. Counts are unsigned int and
+// wrap on overflow, like iceberg_avoiding_dyn_prog. scratch is reused
+// between calls to avoid reallocating.
+//
+// The grids must be non-empty and the level must be supported.
+void iceberg_avoiding_dyn_prog_lanes(const grid* const* settings,
+                                     unsigned int* results,
+                                     std::vector<unsigned int>& scratch,
+                                     simd_level level = detect_simd_level()) {
+
+  assert(simd_level_supported(level));
+  for (coordinate l = 1; l < simd_lane_count(level); ++l) {
+    assert(settings[l]->rows() == settings[0]->rows());
+    assert(settings[l]->columns() == settings[0]->columns());
+  }
+
+#ifdef ICES_SIMD_X86
+  if (level == SIMD_AVX2) {
+    dyn_prog_lanes_avx2(settings, results, scratch);
+    return;
+  }
+  if (level == SIMD_SSE4) {
+    dyn_prog_lanes_sse4(settings, results, scratch);
+    return;
+  }
+#endif
+  results[0] = iceberg_avoiding_dyn_prog(*settings[0]);
+}
+
+}
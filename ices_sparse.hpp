@@ -0,0 +1,458 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_sparse.hpp
+//
+// Counting paths through sparse charts by inclusion-exclusion.
+//
+// Without icebergs there are C(down + right, down) monotone paths between
+// two cells. Sort the icebergs in row-major order and let f(i) be the
+// number of paths from (0, 0) to iceberg i that touch no earlier iceberg.
+// Every path to iceberg i either avoids the earlier icebergs or first
+// touches some iceberg j before it, so
+//
+//   f(i) = C(paths from (0, 0) to i) - sum over j of f(j) * C(paths j to i),
+//
+// and treating the goal as one more iceberg gives the answer. That takes
+// O(k^2) binomial coefficients for k icebergs, whatever the area of the
+// grid, so a chart of millions of cells with a few hundred icebergs is
+// solved in a fraction of the time of the dynamic programming.
+//
+// The binomials depend on the count policy, since inclusion-exclusion
+// subtracts and the policies do not all support subtraction:
+//
+//   wrapping_count  factorials modulo 2^32, split into an odd part, which
+//                   has an inverse, and a power of two
+//   modular_count   factorials and inverse factorials modulo the modulus,
+//                   falling back to exact counts when the modulus shares a
+//                   factor with a factorial, as it can when it is not prime
+//   checked_count   exact 64-bit arithmetic when the total number of paths
+//                   fits, exact counts clamped to OVERFLOW_VALUE otherwise
+//   exact_count     counts modulo several primes near 2^62, combined by
+//                   the Chinese remainder theorem
+//
+// In every case the result is exactly that of iceberg_avoiding_dyn_prog.
+//
+// This file builds on ices_types.hpp and ices_count.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "ices_count.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// The position of one cell.
+struct cell_position {
+  coordinate row, column;
+
+  bool operator==(const cell_position& o) const {
+    return (row == o.row) && (column == o.column);
+  }
+  bool operator<(const cell_position& o) const {
+    return (row < o.row) || ((row == o.row) && (column < o.column));
+  }
+};
+
+// Return the positions of the icebergs of the given grid, in row-major
+// order. This scans the packed words, skipping 64 cells of water at a time.
+std::vector<cell_position> iceberg_positions(const grid& setting) {
+  std::vector<cell_position> result;
+  for (coordinate r = 0; r < setting.rows(); ++r) {
+    const grid::word* ice = setting.row_words(r);
+    for (coordinate k = 0; k < setting.words_per_row(); ++k) {
+      for (grid::word w = ice[k]; w != 0; w &= w - 1) {
+        result.push_back({r, k * grid::WORD_BITS + __builtin_ctzll(w)});
+      }
+    }
+  }
+  return result;
+}
+
+// Return C(n, k) if it fits in 64 bits, or std::nullopt if not.
+//
+// Each partial product C(n - k + i, i) is at most C(n, k), so when the
+// result fits, multiplying one into the next needs only 128 bits.
+std::optional<std::uint64_t> word_binomial(std::uint64_t n, std::uint64_t k) {
+  assert(k <= n);
+  k = std::min(k, n - k);
+  unsigned __int128 result = 1;
+  for (std::uint64_t i = 1; i <= k; ++i) {
+    result = result * (n - k + i) / i;
+    if (result > std::numeric_limits<std::uint64_t>::max()) {
+      return std::nullopt;
+    }
+  }
+  return std::uint64_t(result);
+}
+
+// Count the paths from (0, 0) to (rows-1, columns-1) that avoid the given
+// icebergs, which must be sorted in row-major order, distinct, inside the
+// grid, and not at (0, 0).
+//
+// Binomials supplies the arithmetic: value_type, zero(), paths(down, right),
+// the number of icebergless paths between cells that far apart, multiply,
+// and subtract(a, b), which sets a to a - b.
+template <typename Binomials>
+typename Binomials::value_type
+inclusion_exclusion_count(coordinate rows, coordinate columns,
+                          const std::vector<cell_position>& icebergs,
+                          const Binomials& binomials) {
+
+  assert(rows > 0);
+  assert(columns > 0);
+
+  const cell_position goal{rows - 1, columns - 1};
+  if (!icebergs.empty() && (icebergs.back() == goal)) {
+    return binomials.zero();
+  }
+
+  // avoiding[i] is f(i) for the icebergs, then for the goal.
+  std::vector<typename Binomials::value_type> avoiding;
+  avoiding.reserve(icebergs.size() + 1);
+  for (size_t i = 0; i <= icebergs.size(); ++i) {
+    const cell_position& to = (i < icebergs.size()) ? icebergs[i] : goal;
+    auto count = binomials.paths(to.row, to.column);
+    for (size_t j = 0; j < i; ++j) {
+      const cell_position& from = icebergs[j];
+      // Earlier icebergs are in rows no lower than to, but may be right of
+      // it.
+      if (from.column <= to.column) {
+        binomials.subtract(count, binomials.multiply(
+          avoiding[j], binomials.paths(to.row - from.row,
+                                       to.column - from.column)));
+      }
+    }
+    avoiding.push_back(count);
+  }
+  return avoiding.back();
+}
+
+// Binomials modulo 2^32, for wrapping_count.
+//
+// Only odd numbers have inverses modulo a power of two, so each n! is
+// stored as an odd part and a power of two, and
+//
+//   C(n, k) = odd(n) / (odd(k) * odd(n - k)) * 2^(twos(n) - twos(k) - twos(n - k)).
+class wrapping_binomials {
+public:
+  using value_type = wrapping_count::value_type;
+
+private:
+  std::vector<value_type> odd_, inverse_odd_;
+  std::vector<unsigned> twos_;
+
+  // Return the inverse of the odd value a. Each Newton step doubles the
+  // number of correct low bits, starting from the 3 that a gives.
+  static value_type inverse(value_type a) {
+    assert(a & 1);
+    value_type x = a;
+    for (int i = 0; i < 5; ++i) {
+      x *= 2 - a * x;
+    }
+    return x;
+  }
+
+public:
+
+  // Create tables for paths of up to max_steps steps.
+  explicit wrapping_binomials(coordinate max_steps)
+  : odd_(max_steps + 1), inverse_odd_(max_steps + 1), twos_(max_steps + 1) {
+    odd_[0] = 1;
+    twos_[0] = 0;
+    for (coordinate n = 1; n <= max_steps; ++n) {
+      unsigned twos = __builtin_ctzll(n);
+      odd_[n] = odd_[n - 1] * value_type(n >> twos);
+      twos_[n] = twos_[n - 1] + twos;
+    }
+    for (coordinate n = 0; n <= max_steps; ++n) {
+      inverse_odd_[n] = inverse(odd_[n]);
+    }
+  }
+
+  value_type zero() const { return 0; }
+  value_type paths(coordinate down, coordinate right) const {
+    coordinate n = down + right;
+    assert(n < odd_.size());
+    unsigned twos = twos_[n] - twos_[down] - twos_[right];
+    if (twos >= unsigned(std::numeric_limits<value_type>::digits)) {
+      return 0;
+    }
+    return (odd_[n] * inverse_odd_[down] * inverse_odd_[right]) << twos;
+  }
+  value_type multiply(value_type a, value_type b) const { return a * b; }
+  void subtract(value_type& a, value_type b) const { a -= b; }
+};
+
+// Return the inverse of a modulo modulus, or std::nullopt if a and modulus
+// have a common factor, by the extended Euclidean algorithm.
+std::optional<std::uint64_t> modular_inverse(std::uint64_t a,
+                                             std::uint64_t modulus) {
+  __int128 r0 = modulus, r1 = a % modulus, s0 = 0, s1 = 1;
+  while (r1 != 0) {
+    __int128 q = r0 / r1, r = r0 - q * r1, s = s0 - q * s1;
+    r0 = r1;
+    r1 = r;
+    s0 = s1;
+    s1 = s;
+  }
+  if (r0 != 1) {
+    return std::nullopt;
+  }
+  if (s0 < 0) {
+    s0 += modulus;
+  }
+  return std::uint64_t(s0);
+}
+
+// Binomials modulo the modulus of a modular_count, from tables of
+// factorials and inverse factorials.
+class modular_binomials {
+public:
+  using value_type = modular_count::value_type;
+
+private:
+  modular_count policy_;
+  std::vector<value_type> factorial_, inverse_factorial_;
+
+  modular_binomials(coordinate max_steps, const modular_count& policy)
+  : policy_(policy),
+    factorial_(max_steps + 1),
+    inverse_factorial_(max_steps + 1) { }
+
+public:
+
+  // Return tables for paths of up to max_steps steps, or std::nullopt if
+  // max_steps! has no inverse modulo the modulus, which for a prime
+  // modulus means max_steps is at least the modulus.
+  static std::optional<modular_binomials> create(coordinate max_steps,
+                                                 const modular_count& policy) {
+    modular_binomials result(max_steps, policy);
+    result.factorial_[0] = policy.one();
+    for (coordinate n = 1; n <= max_steps; ++n) {
+      result.factorial_[n] = policy.multiply(result.factorial_[n - 1],
+                                             n % policy.modulus());
+    }
+    auto last = modular_inverse(result.factorial_[max_steps],
+                                policy.modulus());
+    if (!last) {
+      return std::nullopt;
+    }
+    result.inverse_factorial_[max_steps] = *last;
+    for (coordinate n = max_steps; n > 0; --n) {
+      result.inverse_factorial_[n - 1] =
+        policy.multiply(result.inverse_factorial_[n], n % policy.modulus());
+    }
+    return result;
+  }
+
+  value_type zero() const { return 0; }
+  value_type paths(coordinate down, coordinate right) const {
+    assert(down + right < factorial_.size());
+    return policy_.multiply(policy_.multiply(factorial_[down + right],
+                                             inverse_factorial_[down]),
+                            inverse_factorial_[right]);
+  }
+  value_type multiply(value_type a, value_type b) const {
+    return policy_.multiply(a, b);
+  }
+  void subtract(value_type& a, value_type b) const {
+    a = (a >= b) ? a - b : a + (policy_.modulus() - b);
+  }
+};
+
+// Exact binomials in 64 bits, for grids whose total number of paths fits,
+// which bounds every binomial and every intermediate count.
+struct word_binomials {
+  using value_type = std::uint64_t;
+
+  value_type zero() const { return 0; }
+  value_type paths(coordinate down, coordinate right) const {
+    auto result = word_binomial(down + right, down);
+    assert(result);
+    return *result;
+  }
+  value_type multiply(value_type a, value_type b) const { return a * b; }
+  void subtract(value_type& a, value_type b) const {
+    assert(b <= a);
+    a -= b;
+  }
+};
+
+// Return true if n is prime, by the Miller-Rabin test with the first
+// twelve primes as bases, which is exact for every 64-bit n.
+bool is_prime(std::uint64_t n) {
+  const std::uint64_t BASES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+  if (n < 2) {
+    return false;
+  }
+  for (auto b : BASES) {
+    if (n % b == 0) {
+      return n == b;
+    }
+  }
+  modular_count policy(n);
+  unsigned twos = __builtin_ctzll(n - 1);
+  std::uint64_t odd = (n - 1) >> twos;
+  for (auto b : BASES) {
+    std::uint64_t x = 1, power = b;
+    for (std::uint64_t e = odd; e != 0; e >>= 1) {
+      if (e & 1) {
+        x = policy.multiply(x, power);
+      }
+      power = policy.multiply(power, power);
+    }
+    bool witness = (x != 1) && (x != n - 1);
+    for (unsigned i = 1; witness && (i < twos); ++i) {
+      x = policy.multiply(x, x);
+      witness = (x != n - 1);
+    }
+    if (witness) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Count the paths exactly, by counting them modulo enough primes near 2^62
+// that their product exceeds the number of icebergless paths, which bounds
+// the answer, and combining the residues by the Chinese remainder theorem.
+//
+// Binomials with tens of thousands of bits make a direct big_unsigned
+// computation slow, while each prime costs only O(rows + columns + k^2)
+// word operations, and the number of primes grows with the number of bits
+// in the answer.
+big_unsigned inclusion_exclusion_exact(coordinate rows, coordinate columns,
+                                       const std::vector<cell_position>& icebergs) {
+
+  const coordinate steps = rows + columns - 2;
+  assert(steps < (std::uint64_t(1) << 62));
+
+  // log2 of C(steps, rows - 1), with a margin for rounding.
+  double bits = (std::lgamma(double(steps) + 1) - std::lgamma(double(rows)) -
+                 std::lgamma(double(columns))) / std::log(2.0) + 2;
+
+  // residues[i] is the count modulo primes[i]; digits[i] is the mixed-radix
+  // digit of Garner's algorithm, so the count is digits[0] + primes[0] *
+  // (digits[1] + primes[1] * (digits[2] + ...)).
+  std::vector<std::uint64_t> primes, digits;
+  std::uint64_t candidate = (std::uint64_t(1) << 62) + 1;
+  for (double covered = 0; covered < bits; ) {
+    do {
+      candidate -= 2;
+    } while (!is_prime(candidate));
+    modular_count policy(candidate);
+    auto binomials = modular_binomials::create(steps, policy);
+    assert(binomials);
+    std::uint64_t residue = inclusion_exclusion_count(rows, columns, icebergs,
+                                                      *binomials);
+
+    // Subtract the value of the earlier digits modulo this prime, and
+    // divide by the product of the earlier primes.
+    std::uint64_t prefix = 0, radix = 1;
+    for (size_t i = 0; i < primes.size(); ++i) {
+      policy.add_to(prefix, policy.multiply(digits[i] % candidate, radix));
+      radix = policy.multiply(radix, primes[i] % candidate);
+    }
+    std::uint64_t difference = (residue >= prefix)
+      ? residue - prefix : residue + (candidate - prefix);
+    digits.push_back(policy.multiply(difference,
+                                     *modular_inverse(radix, candidate)));
+    primes.push_back(candidate);
+    covered += std::log2(double(candidate));
+  }
+
+  big_unsigned result = digits.back();
+  for (size_t i = digits.size() - 1; i-- > 0; ) {
+    result = result * big_unsigned(primes[i]);
+    result += big_unsigned(digits[i]);
+  }
+  return result;
+}
+
+// Sort and deduplicate a list of iceberg positions for
+// inclusion_exclusion_count, checking that each is inside a grid with the
+// given shape and not at (0, 0).
+void prepare_icebergs(coordinate rows, coordinate columns,
+                      std::vector<cell_position>& icebergs) {
+  std::sort(icebergs.begin(), icebergs.end());
+  icebergs.erase(std::unique(icebergs.begin(), icebergs.end()),
+                 icebergs.end());
+  for (auto& p : icebergs) {
+    assert((p.row < rows) && (p.column < columns));
+    assert((p.row != 0) || (p.column != 0));
+  }
+}
+
+// Solve the iceberg avoiding problem for a rows x columns grid with
+// icebergs at the given positions, in any order, by inclusion-exclusion.
+// One overload per count policy chooses how the binomials are computed.
+big_unsigned iceberg_avoiding_sparse(coordinate rows, coordinate columns,
+                                     std::vector<cell_position> icebergs,
+                                     const exact_count&) {
+  prepare_icebergs(rows, columns, icebergs);
+  return inclusion_exclusion_exact(rows, columns, icebergs);
+}
+
+unsigned int iceberg_avoiding_sparse(coordinate rows, coordinate columns,
+                                     std::vector<cell_position> icebergs,
+                                     const wrapping_count&) {
+  prepare_icebergs(rows, columns, icebergs);
+  return inclusion_exclusion_count(rows, columns, icebergs,
+                                   wrapping_binomials(rows + columns - 2));
+}
+
+std::uint64_t iceberg_avoiding_sparse(coordinate rows, coordinate columns,
+                                      std::vector<cell_position> icebergs,
+                                      const modular_count& policy) {
+  prepare_icebergs(rows, columns, icebergs);
+  auto binomials = modular_binomials::create(rows + columns - 2, policy);
+  if (binomials) {
+    return inclusion_exclusion_count(rows, columns, icebergs, *binomials);
+  }
+  big_unsigned exact = inclusion_exclusion_exact(rows, columns, icebergs);
+  return exact.divide_small(policy.modulus());
+}
+
+std::uint64_t iceberg_avoiding_sparse(coordinate rows, coordinate columns,
+                                      std::vector<cell_position> icebergs,
+                                      const checked_count&) {
+  prepare_icebergs(rows, columns, icebergs);
+  if (word_binomial(rows + columns - 2, rows - 1)) {
+    return inclusion_exclusion_count(rows, columns, icebergs,
+                                     word_binomials());
+  }
+  // The dynamic programming saturates only when the true count reaches
+  // OVERFLOW_VALUE, since every count feeding into the goal is at most the
+  // count at the goal.
+  big_unsigned exact = inclusion_exclusion_exact(rows, columns, icebergs);
+  if (exact.limbs().size() > 1) {
+    return checked_count::OVERFLOW_VALUE;
+  }
+  return exact.is_zero() ? 0 : exact.limbs()[0];
+}
+
+// Solve the iceberg avoiding problem for a grid by inclusion-exclusion over
+// its icebergs. Finding the icebergs takes O(rows * columns / 64) time, so
+// for the largest charts pass the positions directly.
+template <typename Policy>
+typename Policy::value_type
+iceberg_avoiding_sparse(const grid& setting, const Policy& policy) {
+  return iceberg_avoiding_sparse(setting.rows(), setting.columns(),
+                                 iceberg_positions(setting), policy);
+}
+
+// Inclusion-exclusion with unsigned int counts that wrap on overflow.
+unsigned int iceberg_avoiding_sparse(const grid& setting) {
+  return iceberg_avoiding_sparse(setting, wrapping_count());
+}
+
+}
@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_stats.hpp
+//
+// Instrumentation for the iceberg avoiding solvers.
+//
+// The solvers in ices_algs.hpp are templated on a stats recorder, much as
+// they are templated on a count policy. A recorder provides:
+//
+//   void add_candidates(std::uint64_t n)  n candidates were examined
+//   void add_pruned(std::uint64_t n)      n candidates were rejected
+//                                         without being examined in full
+//   void add_cells(std::uint64_t n)       n grid cells were processed
+//   void add_bytes(std::uint64_t n)       n bytes were allocated
+//   phase_scope phase(solver_phase p)     time phase p until the returned
+//                                         object is destroyed
+//
+// null_stats does nothing, and all of its functions are empty and inline,
+// so a solver instantiated with it compiles to exactly the code it had
+// before instrumentation; this is what the ordinary solver entry points
+// use. recording_stats fills in a solver_stats.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+#include "timer.hpp"
+
+namespace ices {
+
+// The phases a solver's running time is divided into.
+enum solver_phase {
+  PHASE_PREPARE, // copying the grid, allocating, pruning dead ends
+  PHASE_SOLVE,   // the search or recurrence itself
+  PHASE_COUNT
+};
+
+// Return a short name for a phase.
+inline const char* phase_name(solver_phase phase) {
+  switch (phase) {
+  case PHASE_PREPARE: return "prepare";
+  case PHASE_SOLVE: return "solve";
+  default: return "?";
+  }
+}
+
+// What a solver did, as recorded by recording_stats.
+//
+// What counts as a candidate depends on the solver: for the exhaustive
+// search it is a complete path, for backtracking a path prefix, and the
+// dynamic programming solvers have none.
+struct solver_stats {
+  std::uint64_t candidates_examined = 0;
+  std::uint64_t candidates_pruned = 0;
+  std::uint64_t cells_processed = 0;
+  std::uint64_t bytes_allocated = 0;
+  double phase_seconds[PHASE_COUNT] = {};
+};
+
+// Print a solver_stats on one line.
+inline std::ostream& operator<<(std::ostream& out, const solver_stats& stats) {
+  out << "candidates=" << stats.candidates_examined
+      << " pruned=" << stats.candidates_pruned
+      << " cells=" << stats.cells_processed
+      << " bytes=" << stats.bytes_allocated;
+  for (int p = 0; p < PHASE_COUNT; ++p) {
+    out << " " << phase_name(solver_phase(p)) << "="
+        << stats.phase_seconds[p] << "s";
+  }
+  return out;
+}
+
+// Stats recorder that records nothing.
+struct null_stats {
+  struct phase_scope {
+    // Declared so an unused scope variable does not draw a warning.
+    ~phase_scope() { }
+  };
+
+  constexpr void add_candidates(std::uint64_t) { }
+  constexpr void add_pruned(std::uint64_t) { }
+  constexpr void add_cells(std::uint64_t) { }
+  constexpr void add_bytes(std::uint64_t) { }
+  phase_scope phase(solver_phase) { return phase_scope(); }
+};
+
+// Stats recorder that records everything into a solver_stats.
+class recording_stats {
+private:
+  solver_stats stats_;
+
+public:
+
+  // Adds the time between its creation and destruction to one phase.
+  class phase_scope {
+  private:
+    double* seconds_;
+    Timer timer_;
+
+  public:
+    explicit phase_scope(double* seconds) : seconds_(seconds) { }
+    phase_scope(const phase_scope&) = delete;
+    phase_scope& operator=(const phase_scope&) = delete;
+    ~phase_scope() { *seconds_ += timer_.elapsed(); }
+  };
+
+  // Accessor.
+  const solver_stats& stats() const { return stats_; }
+
+  void add_candidates(std::uint64_t n) { stats_.candidates_examined += n; }
+  void add_pruned(std::uint64_t n) { stats_.candidates_pruned += n; }
+  void add_cells(std::uint64_t n) { stats_.cells_processed += n; }
+  void add_bytes(std::uint64_t n) { stats_.bytes_allocated += n; }
+  phase_scope phase(solver_phase p) {
+    return phase_scope(&stats_.phase_seconds[p]);
+  }
+};
+
+// A solution together with the stats recorded while finding it.
+template <typename Count>
+struct solution_with_stats {
+  Count count;
+  solver_stats stats;
+};
+
+}
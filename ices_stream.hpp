@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////////
+// ices_stream.hpp
+//
+// Solving the iceberg avoiding problem on charts streamed one row at a time.
+//
+// The rolling-row dynamic programming algorithm only ever looks at the row
+// of counts above the current row, so a chart never needs to be held in
+// memory as a whole: rows can be consumed as they arrive from a file, a
+// pipe, or a network, in O(columns) memory.
+//
+// This file builds on ices_algs.hpp and the formats of ices_io.hpp.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ices_algs.hpp"
+#include "ices_count.hpp"
+#include "ices_io.hpp"
+#include "ices_types.hpp"
+
+namespace ices {
+
+// Solves the iceberg avoiding problem for a chart whose rows are pushed one
+// at a time, top to bottom. After any number of rows, count() is the
+// solution for the chart made of the rows pushed so far.
+template <typename Policy>
+class streaming_solver {
+public:
+  using value_type = typename Policy::value_type;
+
+private:
+  Policy policy_;
+  coordinate columns_, rows_;
+  std::vector<value_type> counts_;
+  std::vector<grid::word> row_;
+
+public:
+
+  // Create a solver for charts with the given number of columns.
+  explicit streaming_solver(coordinate columns, const Policy& policy = Policy())
+  : policy_(policy),
+    columns_(columns),
+    rows_(0),
+    counts_(columns, policy.zero()),
+    row_(grid::words_for_columns(columns), 0) {
+
+    assert(columns > 0);
+
+    counts_[0] = policy_.one(); // base case
+  }
+
+  // Accessors.
+  coordinate columns() const { return columns_; }
+  coordinate rows() const { return rows_; }
+
+  // Return the number of paths to the bottom-right cell of the rows pushed
+  // so far. At least one row must have been pushed.
+  const value_type& count() const {
+    assert(rows_ > 0);
+    return counts_.back();
+  }
+
+  // Push the next row as words_for_columns(columns()) packed words in the
+  // layout of grid::row_words. Bits past the last column are ignored. The
+  // first row must not have an iceberg at column 0.
+  void push_row_words(const grid::word* words) {
+    assert((rows_ > 0) || !(words[0] & 1));
+    dyn_prog_row(words, counts_.data(), columns_, policy_);
+    ++rows_;
+  }
+
+  // Push the next row in the text format of ices_io.hpp. Returns false,
+  // leaving the solver unchanged, when the row has the wrong length, holds
+  // a character other than '.' or 'X', or would put an iceberg at (0, 0).
+  bool push_row(const std::string& line) {
+    if (line.size() != columns_) {
+      return false;
+    }
+    std::fill(row_.begin(), row_.end(), 0);
+    for (coordinate c = 0; c < columns_; ++c) {
+      if (line[c] == 'X') {
+        row_[c / grid::WORD_BITS] |= grid::word(1) << (c % grid::WORD_BITS);
+      } else if (line[c] != '.') {
+        return false;
+      }
+    }
+    if ((rows_ == 0) && (row_[0] & 1)) {
+      return false;
+    }
+    push_row_words(row_.data());
+    return true;
+  }
+};
+
+// Run read_block and process_block as a double-buffered pipeline: while
+// block n is being processed, block n+1 is read on another thread.
+// read_block(buffer) fills buffer and returns false at end of input;
+// process_block(buffer) returns false to stop early. Returns false if
+// processing stopped early.
+template <typename Block, typename ReadBlock, typename ProcessBlock>
+bool read_ahead_pipeline(ReadBlock read_block, ProcessBlock process_block) {
+
+  Block buffers[2];
+  int current = 0;
+  std::future<bool> pending = std::async(std::launch::async, read_block,
+                                         std::ref(buffers[current]));
+  while (pending.get()) {
+    pending = std::async(std::launch::async, read_block,
+                         std::ref(buffers[1 - current]));
+    if (!process_block(buffers[current])) {
+      pending.wait();
+      return false;
+    }
+    current = 1 - current;
+  }
+  return true;
+}
+
+// The default size in bytes of one block of rows read ahead by the
+// streaming solvers.
+const size_t STREAM_BLOCK_BYTES = size_t(1) << 20;
+
+// Return the number of rows of row_bytes bytes each that fit in a block of
+// block_bytes bytes, and at least 1, so a row wider than the block is still
+// read whole.
+size_t stream_block_rows(size_t block_bytes, size_t row_bytes) {
+  return std::max<size_t>(1, block_bytes / std::max<size_t>(1, row_bytes));
+}
+
+// Solve the iceberg avoiding problem for a chart in the text format of
+// ices_io.hpp, read from the given stream until end of file or an empty
+// line. Rows are read in blocks of about block_bytes bytes on a separate
+// thread, so reading overlaps solving; the number of rows per block is
+// derived from the length of the first line. Returns std::nullopt under
+// the same conditions as read_text_grid.
+template <typename Policy>
+std::optional<typename Policy::value_type>
+solve_text_stream(std::istream& in, const Policy& policy,
+                  size_t block_bytes = STREAM_BLOCK_BYTES) {
+
+  std::optional<streaming_solver<Policy>> solver;
+  bool finished = false;
+  size_t rows_per_block = 0; // until the first line is read
+  std::string line;
+
+  bool ok = read_ahead_pipeline<std::vector<std::string>>(
+    [&](std::vector<std::string>& block) {
+      size_t count = 0;
+      while (!finished && std::getline(in, line)) {
+        if (!line.empty() && (line.back() == '\r')) {
+          line.pop_back();
+        }
+        if (line.empty()) {
+          finished = true;
+          break;
+        }
+        if (rows_per_block == 0) {
+          rows_per_block = stream_block_rows(block_bytes, line.size());
+        }
+        if (block.size() <= count) {
+          block.resize(count + 1);
+        }
+        block[count].swap(line);
+        if (++count == rows_per_block) {
+          break;
+        }
+      }
+      block.resize(count);
+      return count > 0;
+    },
+    [&](const std::vector<std::string>& block) {
+      if (!solver) {
+        solver.emplace(std::max<size_t>(1, block.front().size()), policy);
+      }
+      for (auto& line : block) {
+        if (!solver->push_row(line)) {
+          return false;
+        }
+      }
+      return true;
+    });
+
+  if (!ok || !solver) {
+    return std::nullopt;
+  }
+  return solver->count();
+}
+
+// Solve the iceberg avoiding problem for a chart in the binary format of
+// ices_io.hpp, read from the given stream. Rows are read in blocks of about
+// block_bytes bytes on a separate thread, so reading overlaps solving; the
+// number of rows per block is derived from the number of columns. Returns
+// std::nullopt under the same conditions as read_binary_grid.
+template <typename Policy>
+std::optional<typename Policy::value_type>
+solve_binary_stream(std::istream& in, const Policy& policy,
+                    size_t block_bytes = STREAM_BLOCK_BYTES) {
+
+  binary_grid_header header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      !is_valid_header(header)) {
+    return std::nullopt;
+  }
+  auto remaining = remaining_bytes(in);
+  if (remaining &&
+      (*remaining / sizeof(grid::word) < *header_word_count(header))) {
+    return std::nullopt;
+  }
+
+  streaming_solver<Policy> solver(header.columns, policy);
+  const coordinate words = grid::words_for_columns(header.columns);
+  const size_t rows_per_block =
+    stream_block_rows(block_bytes, words * sizeof(grid::word));
+  coordinate rows_left = header.rows;
+  bool truncated = false;
+
+  bool ok = read_ahead_pipeline<std::vector<grid::word>>(
+    [&](std::vector<grid::word>& block) {
+      coordinate rows = std::min<coordinate>(rows_left, rows_per_block);
+      block.resize(rows * words);
+      if (!in.read(reinterpret_cast<char*>(block.data()),
+                   block.size() * sizeof(grid::word))) {
+        truncated = (rows > 0);
+        return false;
+      }
+      rows_left -= rows;
+      return rows > 0;
+    },
+    [&](const std::vector<grid::word>& block) {
+      for (size_t offset = 0; offset < block.size(); offset += words) {
+        if ((solver.rows() == 0) && (block[0] & 1)) {
+          return false;
+        }
+        solver.push_row_words(block.data() + offset);
+      }
+      return true;
+    });
+
+  if (!ok || truncated) {
+    return std::nullopt;
+  }
+  return solver.count();
+}
+
+// Streaming solvers with unsigned int counts that wrap on overflow.
+std::optional<unsigned int> solve_text_stream(std::istream& in) {
+  return solve_text_stream(in, wrapping_count());
+}
+std::optional<unsigned int> solve_binary_stream(std::istream& in) {
+  return solve_binary_stream(in, wrapping_count());
+}
+
+}
@@ -6,12 +6,31 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <random>
+#include <sstream>
 
 #include "rubrictest.hpp"
 
 #include "ices_types.hpp"
 #include "ices_algs.hpp"
+#include "ices_batch.hpp"
+#include "ices_cache.hpp"
+#include "ices_chokepoints.hpp"
+#include "ices_context.hpp"
+#include "ices_fixed.hpp"
+#include "ices_incremental.hpp"
+#include "ices_io.hpp"
+#include "ices_parallel.hpp"
+#include "ices_reach.hpp"
+#include "ices_rle.hpp"
+#include "ices_paths.hpp"
+#include "ices_random.hpp"
+#include "ices_simd.hpp"
+#include "ices_sparse.hpp"
+#include "ices_stats.hpp"
+#include "ices_stream.hpp"
 
 int main() {
 
@@ -62,6 +81,27 @@ int main() {
                medium_random = ices::grid::random(12, 25, 50, gen),
                large_random =  ices::grid::random(20, 79, 211, gen);
       
+  rubric.criterion("grid - packed storage", 1, [&]() {
+      ices::grid wide(3, 130);
+      TEST_EQUAL("rows", 3, wide.rows());
+      TEST_EQUAL("columns", 130, wide.columns());
+      TEST_EQUAL("words per row", 3, wide.words_per_row());
+      wide.set(1, 0, ices::CELL_ICEBERG);
+      wide.set(1, 64, ices::CELL_ICEBERG);
+      wide.set(2, 129, ices::CELL_ICEBERG);
+      TEST_EQUAL("get iceberg", ices::CELL_ICEBERG, wide.get(1, 64));
+      TEST_EQUAL("get water", ices::CELL_WATER, wide.get(1, 63));
+      TEST_FALSE("may_step iceberg", wide.may_step(2, 129));
+      TEST_FALSE("may_step outside", wide.may_step(3, 0));
+      TEST_TRUE("may_step water", wide.may_step(0, 129));
+      TEST_EQUAL("row word 0", 1, wide.row_words(1)[0]);
+      TEST_EQUAL("row word 1", 1, wide.row_words(1)[1]);
+      TEST_EQUAL("row word 2", ices::grid::word(1) << 1, wide.row_words(2)[2]);
+      wide.set(1, 64, ices::CELL_WATER);
+      TEST_EQUAL("cleared", 0, wide.row_words(1)[1]);
+      TEST_EQUAL("printable", std::string("X..X"), maze.printable()[1]);
+    });
+
   rubric.criterion("exhaustive search - simple cases", 4, [&]() {
       TEST_EQUAL("empty2", empty2_solution, iceberg_avoiding_exhaustive(empty2));
       TEST_EQUAL("empty4", empty4_solution, iceberg_avoiding_exhaustive(empty4));
@@ -75,6 +115,53 @@ int main() {
       TEST_EQUAL("correct", maze_solution, iceberg_avoiding_exhaustive(maze));
     });
   
+  rubric.criterion("exhaustive search - shapes", 1, [&]() {
+      ices::grid single(1, 1), row(1, 30), column(30, 1), tall(30, 3);
+      TEST_EQUAL("single cell", 1, iceberg_avoiding_exhaustive(single));
+      TEST_EQUAL("one row", 1, iceberg_avoiding_exhaustive(row));
+      TEST_EQUAL("one column", 1, iceberg_avoiding_exhaustive(column));
+      TEST_EQUAL("tall", 465, iceberg_avoiding_exhaustive(tall));
+      row.set(0, 17, ices::CELL_ICEBERG);
+      TEST_EQUAL("blocked row", 0, iceberg_avoiding_exhaustive(row));
+      ices::grid open(12, 12);
+      TEST_EQUAL("open 12x12", iceberg_avoiding_dyn_prog(open),
+                 iceberg_avoiding_exhaustive(open));
+      TEST_EQUAL("small random", iceberg_avoiding_dyn_prog(small_random),
+                 iceberg_avoiding_exhaustive(small_random));
+    });
+
+  rubric.criterion("backtracking search", 1, [&]() {
+      for (bool prune : {false, true}) {
+        std::string mode = prune ? " (pruned)" : "";
+        TEST_EQUAL("empty4" + mode, empty4_solution,
+                   iceberg_avoiding_backtracking(empty4, prune));
+        TEST_EQUAL("vertical" + mode, vertical_solution,
+                   iceberg_avoiding_backtracking(vertical, prune));
+        TEST_EQUAL("all_ices" + mode, all_ices_solution,
+                   iceberg_avoiding_backtracking(all_ices, prune));
+        TEST_EQUAL("maze" + mode, maze_solution,
+                   iceberg_avoiding_backtracking(maze, prune));
+        TEST_EQUAL("medium" + mode, iceberg_avoiding_dyn_prog(medium_random),
+                   iceberg_avoiding_backtracking(medium_random, prune));
+      }
+
+      // A 2-wide channel 200 rows long, far beyond 64 steps.
+      ices::grid channel(200, 40);
+      for (ices::coordinate r = 0; r < 200; ++r) {
+        for (ices::coordinate c = 0; c < 40; ++c) {
+          bool in_channel = (r < 199) ? (c < 2) : true;
+          if (!in_channel) {
+            channel.set(r, c, ices::CELL_ICEBERG);
+          }
+        }
+      }
+      TEST_EQUAL("long channel", iceberg_avoiding_dyn_prog(channel),
+                 iceberg_avoiding_backtracking(channel));
+      TEST_EQUAL("long channel exact",
+                 iceberg_avoiding_dyn_prog(channel, ices::exact_count()),
+                 iceberg_avoiding_backtracking(channel, ices::exact_count(), true));
+    });
+
   rubric.criterion("dynamic programming - simple cases", 4, [&]() {
       TEST_EQUAL("empty2", empty2_solution, iceberg_avoiding_dyn_prog(empty2));
       TEST_EQUAL("empty4", empty4_solution, iceberg_avoiding_dyn_prog(empty4));
@@ -92,13 +179,1006 @@ int main() {
       std::cout << std::endl;
      
       auto small_output = iceberg_avoiding_dyn_prog(small_random);
-      TEST_EQUAL("small", 5, small_output);
+      TEST_EQUAL("small", 3, small_output);
       
       auto medium_output = iceberg_avoiding_dyn_prog(medium_random);
-      TEST_EQUAL("medium", 384638, medium_output);
+      TEST_EQUAL("medium", 158298, medium_output);
       
       auto large_output = iceberg_avoiding_dyn_prog(large_random);
-      TEST_EQUAL("large", 1098385592, large_output);
+      TEST_EQUAL("large", 26987948, large_output);
+    });
+
+  rubric.criterion("dynamic programming - arbitrary size", 1, [&]() {
+      ices::grid single(1, 1), tall(1000000, 2), wide(3, 200);
+      TEST_EQUAL("single cell", 1, iceberg_avoiding_dyn_prog(single));
+      TEST_EQUAL("tall", 1000000, iceberg_avoiding_dyn_prog(tall));
+      TEST_EQUAL("wide", 20100, iceberg_avoiding_dyn_prog(wide));
+      wide.set(1, 100, ices::CELL_ICEBERG);
+      TEST_EQUAL("wide with iceberg", 20100 - 101 * 100,
+                 iceberg_avoiding_dyn_prog(wide));
+    });
+
+  rubric.criterion("dynamic programming - full table", 1, [&]() {
+      auto table = iceberg_avoiding_dyn_prog_table(maze);
+      TEST_EQUAL("rows", 4, table.rows());
+      TEST_EQUAL("columns", 4, table.columns());
+      TEST_EQUAL("origin", 1, table.get(0, 0));
+      TEST_EQUAL("iceberg", 0, table.get(1, 0));
+      TEST_EQUAL("solution", maze_solution, table.get(3, 3));
+      auto horizontal_table = iceberg_avoiding_dyn_prog_table(horizontal);
+      TEST_EQUAL("interior", 6, horizontal_table.get(2, 2));
+      TEST_EQUAL("solution", horizontal_solution, horizontal_table.get(3, 3));
+      auto large_table = iceberg_avoiding_dyn_prog_table(large_random);
+      TEST_EQUAL("matches rolling row", iceberg_avoiding_dyn_prog(large_random),
+                 large_table.get(19, 78));
+    });
+
+  rubric.criterion("dynamic programming - count policies", 1, [&]() {
+      ices::grid open34(34, 34), open35(35, 35), open101(101, 101);
+      ices::checked_count checked;
+      auto fits = iceberg_avoiding_dyn_prog(open34, checked);
+      TEST_EQUAL("checked fits", 7219428434016265740ULL, fits);
+      TEST_FALSE("checked fits not overflowed", checked.overflowed(fits));
+      auto overflow = iceberg_avoiding_dyn_prog(open35, checked);
+      TEST_TRUE("checked overflow", checked.overflowed(overflow));
+      TEST_EQUAL("modular", 69287808,
+                 iceberg_avoiding_dyn_prog(open35, ices::modular_count(1000000007)));
+      TEST_EQUAL("exact", "28453041475240576740",
+                 iceberg_avoiding_dyn_prog(open35, ices::exact_count()).to_string());
+      TEST_EQUAL("exact 101x101",
+                 "90548514656103281165404177077484163874504589675413336841320",
+                 iceberg_avoiding_dyn_prog(open101, ices::exact_count()).to_string());
+      TEST_EQUAL("exact maze", ices::big_unsigned(maze_solution),
+                 iceberg_avoiding_dyn_prog(maze, ices::exact_count()));
+      TEST_EQUAL("exhaustive checked", 20,
+                 iceberg_avoiding_exhaustive(empty4, checked));
+      TEST_EQUAL("exhaustive exact", ices::big_unsigned(vertical_solution),
+                 iceberg_avoiding_exhaustive(vertical, ices::exact_count()));
+      TEST_EQUAL("table modular", 5,
+                 iceberg_avoiding_dyn_prog_table(horizontal,
+                                                 ices::modular_count(7)).get(3, 3));
+    });
+
+  rubric.criterion("wavefront - matches dynamic programming", 1, [&]() {
+      std::mt19937 wave_gen(7);
+      const ices::coordinate shapes[][2] = {
+        {1, 1}, {1, 40}, {40, 1}, {31, 33}, {33, 31}, {64, 64}, {70, 150}};
+      for (auto level : {ices::SIMD_SCALAR, ices::SIMD_SSE4, ices::SIMD_AVX2}) {
+        if (!ices::simd_level_supported(level)) {
+          continue;
+        }
+        TEST_EQUAL("maze", maze_solution, iceberg_avoiding_wavefront(maze, level));
+        TEST_EQUAL("large", iceberg_avoiding_dyn_prog(large_random),
+                   iceberg_avoiding_wavefront(large_random, level));
+        for (auto& shape : shapes) {
+          auto cells = shape[0] * shape[1];
+          ices::grid setting = ices::grid::random(shape[0], shape[1],
+                                                  cells > 2 ? cells / 8 : 0,
+                                                  wave_gen);
+          TEST_EQUAL("random " + std::to_string(shape[0]) + "x" +
+                     std::to_string(shape[1]),
+                     iceberg_avoiding_dyn_prog(setting),
+                     iceberg_avoiding_wavefront(setting, level));
+        }
+      }
+    });
+
+  rubric.criterion("parallel dynamic programming", 1, [&]() {
+      std::mt19937 tile_gen(11);
+      ices::grid setting = ices::grid::random(97, 131, 97 * 131 / 12, tile_gen);
+      auto serial = iceberg_avoiding_dyn_prog(setting, ices::checked_count());
+      for (unsigned threads : {1, 2, 3, 4}) {
+        for (ices::coordinate tile : {1, 7, 32, 500}) {
+          ices::parallel_options options;
+          options.threads = threads;
+          options.tile_size = tile;
+          TEST_EQUAL("threads=" + std::to_string(threads) +
+                     " tile=" + std::to_string(tile), serial,
+                     iceberg_avoiding_dyn_prog_parallel(setting, options,
+                                                        ices::checked_count()));
+        }
+      }
+      TEST_EQUAL("large", iceberg_avoiding_dyn_prog(large_random),
+                 iceberg_avoiding_dyn_prog_parallel(large_random));
+      TEST_EQUAL("maze", maze_solution, iceberg_avoiding_dyn_prog_parallel(maze));
+    });
+
+  rubric.criterion("parallel exhaustive search", 1, [&]() {
+      std::mt19937 prefix_gen(5);
+      ices::grid setting = ices::grid::random(9, 12, 10, prefix_gen);
+      auto serial = iceberg_avoiding_exhaustive(setting);
+      for (unsigned threads : {1, 2, 4}) {
+        for (ices::coordinate prefix : {0, 1, 5, 19}) {
+          ices::parallel_options options;
+          options.threads = threads;
+          options.prefix_steps = prefix;
+          TEST_EQUAL("threads=" + std::to_string(threads) +
+                     " prefix=" + std::to_string(prefix), serial,
+                     iceberg_avoiding_exhaustive_parallel(setting, options));
+        }
+      }
+      ices::grid single(1, 1);
+      TEST_EQUAL("single cell", 1, iceberg_avoiding_exhaustive_parallel(single));
+      TEST_EQUAL("maze", maze_solution, iceberg_avoiding_exhaustive_parallel(maze));
+      TEST_EQUAL("all_ices", all_ices_solution,
+                 iceberg_avoiding_exhaustive_parallel(all_ices));
+      TEST_EQUAL("small exact", ices::big_unsigned(iceberg_avoiding_dyn_prog(small_random)),
+                 iceberg_avoiding_exhaustive_parallel(small_random,
+                                                      ices::parallel_options(),
+                                                      ices::exact_count()));
+    });
+
+  rubric.criterion("batch solving", 1, [&]() {
+      std::mt19937 batch_gen(3);
+      std::vector<ices::grid> batch;
+      for (int i = 0; i < 21; ++i) {
+        batch.push_back(ices::grid::random(8, 8, 10, batch_gen));
+      }
+      for (int i = 0; i < 6; ++i) {
+        batch.push_back(ices::grid::random(5 + i, 40, 20, batch_gen));
+      }
+      batch.push_back(maze);
+      batch.push_back(ices::grid(1, 1));
+      for (int i = 0; i < 9; ++i) {
+        batch.push_back(ices::grid::random(33, 70, 300, batch_gen));
+      }
+
+      for (auto level : {ices::SIMD_SCALAR, ices::SIMD_SSE4, ices::SIMD_AVX2}) {
+        if (!ices::simd_level_supported(level)) {
+          continue;
+        }
+        for (unsigned threads : {1, 3}) {
+          ices::batch_options options;
+          options.threads = threads;
+          options.lanes = level;
+          auto results = iceberg_avoiding_batch(batch, options);
+          TEST_EQUAL("size", batch.size(), results.size());
+          for (size_t i = 0; i < batch.size(); ++i) {
+            TEST_EQUAL("grid " + std::to_string(i), 
+                       iceberg_avoiding_dyn_prog(batch[i]), results[i]);
+          }
+        }
+      }
+
+      auto checked = iceberg_avoiding_batch(batch, ices::batch_options(),
+                                            ices::checked_count());
+      for (size_t i = 0; i < batch.size(); ++i) {
+        TEST_EQUAL("checked grid " + std::to_string(i),
+                   iceberg_avoiding_dyn_prog(batch[i], ices::checked_count()),
+                   checked[i]);
+      }
+      TEST_TRUE("empty batch", iceberg_avoiding_batch(std::vector<ices::grid>()).empty());
+    });
+
+  rubric.criterion("chart files", 1, [&]() {
+      std::stringstream text;
+      write_text_grid(text, maze);
+      TEST_EQUAL("text format", "..XX\nX..X\nXX..\nXXX.\n", text.str());
+      auto parsed = ices::read_text_grid(text);
+      TEST_TRUE("text parsed", parsed.has_value());
+      TEST_TRUE("text round trip", *parsed == maze);
+
+      std::istringstream ragged("...\n..\n"), bad_char("..\n.?\n"),
+        blocked_start("X.\n..\n"), crlf("..X\r\n...\r\n");
+      TEST_FALSE("ragged", ices::read_text_grid(ragged).has_value());
+      TEST_FALSE("bad character", ices::read_text_grid(bad_char).has_value());
+      TEST_FALSE("blocked start", ices::read_text_grid(blocked_start).has_value());
+      auto windows = ices::read_text_grid(crlf);
+      TEST_TRUE("crlf", windows.has_value() && (windows->columns() == 3) &&
+                (windows->get(0, 2) == ices::CELL_ICEBERG));
+
+      std::stringstream binary;
+      TEST_TRUE("binary written", write_binary_grid(binary, large_random));
+      TEST_EQUAL("binary size",
+                 32 + large_random.words().size() * sizeof(ices::grid::word),
+                 binary.str().size());
+      auto decoded = ices::read_binary_grid(binary);
+      TEST_TRUE("binary round trip", decoded.has_value() && (*decoded == large_random));
+      std::istringstream truncated(binary.str().substr(0, 40));
+      TEST_FALSE("truncated", ices::read_binary_grid(truncated).has_value());
+      // Headers whose word counts overflow, or that claim far more cells
+      // than follow them, must be rejected before anything is allocated.
+      const std::uint64_t crafted[][2] = {
+        {1ULL << 40, 1ULL << 30}, {1ULL << 40, 1ULL << 40}, {1ULL << 40, 1},
+        {1ULL << 20, 1ULL << 20}};
+      for (auto& shape : crafted) {
+        ices::binary_grid_header header;
+        std::memcpy(header.magic, ices::BINARY_GRID_MAGIC, 8);
+        header.version = ices::BINARY_GRID_VERSION;
+        header.reserved = 0;
+        header.rows = shape[0];
+        header.columns = shape[1];
+        std::string bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+        bytes += std::string(64, '\0');
+        std::istringstream crafted_in(bytes);
+        TEST_FALSE("crafted header", ices::read_binary_grid(crafted_in).has_value());
+        std::istringstream crafted_stream(bytes);
+        TEST_FALSE("crafted stream",
+                   ices::solve_binary_stream(crafted_stream).has_value());
+      }
+
+      const std::string filename = "ices_test_chart.bin";
+      TEST_TRUE("saved", ices::save_grid(filename, large_random));
+      auto loaded = ices::load_grid(filename);
+      TEST_TRUE("loaded", loaded.has_value() && (*loaded == large_random));
+      {
+        auto mapped = ices::mapped_grid::open(filename);
+        TEST_TRUE("mapped", mapped.has_value());
+        TEST_EQUAL("mapped rows", large_random.rows(), mapped->rows());
+        TEST_EQUAL("mapped columns", large_random.columns(), mapped->columns());
+        TEST_EQUAL("mapped solution", iceberg_avoiding_dyn_prog(large_random),
+                   iceberg_avoiding_dyn_prog(*mapped));
+        TEST_TRUE("mapped copy", mapped->to_grid() == large_random);
+      }
+      std::remove(filename.c_str());
+      TEST_FALSE("missing file", ices::mapped_grid::open(filename).has_value());
+    });
+
+  rubric.criterion("streaming solver", 1, [&]() {
+      ices::streaming_solver<ices::wrapping_count> rows(4);
+      for (auto& line : maze.printable()) {
+        TEST_TRUE("push " + line, rows.push_row(line));
+      }
+      TEST_EQUAL("maze rows", 4, rows.rows());
+      TEST_EQUAL("maze", maze_solution, rows.count());
+      TEST_FALSE("wrong length", rows.push_row("..."));
+      TEST_FALSE("bad character", rows.push_row("..o."));
+      TEST_EQUAL("unchanged", maze_solution, rows.count());
+
+      ices::streaming_solver<ices::modular_count> words(large_random.columns(),
+                                                        ices::modular_count(1000003));
+      for (ices::coordinate r = 0; r < large_random.rows(); ++r) {
+        words.push_row_words(large_random.row_words(r));
+      }
+      TEST_EQUAL("words", iceberg_avoiding_dyn_prog(large_random,
+                                                    ices::modular_count(1000003)),
+                 words.count());
+
+      TEST_EQUAL("one row at least", 1, ices::stream_block_rows(10, 100));
+      TEST_EQUAL("rows per block", 4, ices::stream_block_rows(4096, 1000));
+      for (size_t block : {size_t(1), size_t(3 * large_random.columns()),
+                           ices::STREAM_BLOCK_BYTES}) {
+        std::stringstream text, binary;
+        write_text_grid(text, large_random);
+        write_binary_grid(binary, large_random);
+        auto from_text = ices::solve_text_stream(text, ices::wrapping_count(), block);
+        auto from_binary = ices::solve_binary_stream(binary, ices::wrapping_count(), block);
+        TEST_TRUE("text block " + std::to_string(block),
+                  from_text && (*from_text == iceberg_avoiding_dyn_prog(large_random)));
+        TEST_TRUE("binary block " + std::to_string(block),
+                  from_binary && (*from_binary == iceberg_avoiding_dyn_prog(large_random)));
+      }
+
+      std::istringstream empty(""), ragged("..\n.\n"), blocked("X.\n..\n");
+      TEST_FALSE("empty", ices::solve_text_stream(empty).has_value());
+      TEST_FALSE("ragged", ices::solve_text_stream(ragged).has_value());
+      TEST_FALSE("blocked", ices::solve_text_stream(blocked).has_value());
+      std::stringstream binary;
+      write_binary_grid(binary, large_random);
+      std::istringstream truncated(binary.str().substr(0, binary.str().size() - 8));
+      TEST_FALSE("truncated", ices::solve_binary_stream(truncated).has_value());
+    });
+
+  rubric.criterion("incremental solver", 1, [&]() {
+      ices::incremental_solver<ices::checked_count> solver(medium_random);
+      TEST_EQUAL("initial", iceberg_avoiding_dyn_prog(medium_random,
+                                                      ices::checked_count()),
+                 solver.count());
+
+      std::mt19937 drift_gen(17);
+      std::uniform_int_distribution<ices::coordinate>
+        pick_row(0, medium_random.rows() - 1),
+        pick_column(0, medium_random.columns() - 1);
+      for (int update = 0; update < 200; ++update) {
+        ices::coordinate r = pick_row(drift_gen), c = pick_column(drift_gen);
+        if (r == 0 && c == 0) {
+          continue;
+        }
+        auto kind = (solver.setting().get(r, c) == ices::CELL_WATER)
+          ? ices::CELL_ICEBERG : ices::CELL_WATER;
+        solver.set(r, c, kind);
+        TEST_EQUAL("update " + std::to_string(update),
+                   iceberg_avoiding_dyn_prog(solver.setting(),
+                                             ices::checked_count()),
+                   solver.count());
+      }
+
+      ices::incremental_solver<ices::wrapping_count> corner(empty4);
+      corner.set(3, 2, ices::CELL_ICEBERG);
+      TEST_EQUAL("corner count", 10, corner.count());
+      TEST_EQUAL("corner work", 2, corner.last_update_cells());
+      corner.set(3, 2, ices::CELL_ICEBERG);
+      TEST_EQUAL("no-op work", 0, corner.last_update_cells());
+      corner.set(0, 3, ices::CELL_ICEBERG);
+      TEST_EQUAL("blocked corner", 9, corner.count());
+    });
+
+  rubric.criterion("paths through cells", 1, [&]() {
+      ices::checked_count checked;
+      ices::path_through_table<ices::checked_count> table(small_random);
+      auto total = iceberg_avoiding_dyn_prog(small_random, checked);
+      TEST_EQUAL("total", total, table.total());
+      for (ices::coordinate r = 0; r < small_random.rows(); ++r) {
+        for (ices::coordinate c = 0; c < small_random.columns(); ++c) {
+          std::string where = std::to_string(r) + "," + std::to_string(c);
+          if (small_random.get(r, c) == ices::CELL_ICEBERG) {
+            TEST_EQUAL("iceberg " + where, 0, table.paths_through(r, c));
+          } else if ((r > 0) || (c > 0)) {
+            ices::grid blocked = small_random;
+            blocked.set(r, c, ices::CELL_ICEBERG);
+            TEST_EQUAL("cell " + where,
+                       total - iceberg_avoiding_dyn_prog(blocked, checked),
+                       table.paths_through(r, c));
+          }
+        }
+      }
+
+      auto backward = iceberg_avoiding_backward_table(horizontal, checked);
+      TEST_EQUAL("backward origin", horizontal_solution, backward.get(0, 0));
+      TEST_EQUAL("backward goal", 1, backward.get(3, 3));
+
+      // The checkpointed tables match the full ones whatever order cells are
+      // queried in.
+      std::mt19937 checkpoint_gen(13);
+      for (ices::coordinate rows : {1, 2, 7, 16, 50}) {
+        ices::grid g = ices::grid::random(rows, 70, rows * 70 / 5, checkpoint_gen);
+        using table = ices::checkpointed_count_table<ices::checked_count>;
+        table forward(g, table::FORWARD), backward(g, table::BACKWARD);
+        TEST_TRUE("block rows",
+                  (forward.block_rows() * forward.block_rows() >= rows) &&
+                  ((forward.block_rows() - 1) * (forward.block_rows() - 1) < rows));
+        auto full_forward = iceberg_avoiding_dyn_prog_table(g, checked);
+        auto full_backward = iceberg_avoiding_backward_table(g, checked);
+        TEST_EQUAL("checkpointed total", full_backward.get(0, 0), backward.total());
+        TEST_EQUAL("forward total", full_backward.get(0, 0), forward.total());
+        bool same = true;
+        for (int i = 0; i < 500; ++i) {
+          ices::coordinate r = checkpoint_gen() % rows, c = checkpoint_gen() % 70;
+          same = same && (forward.get(r, c) == full_forward.get(r, c)) &&
+            (backward.get(r, c) == full_backward.get(r, c));
+        }
+        TEST_TRUE("checkpointed cells", same);
+      }
+
+      auto from_table = ices::path_through_table<ices::exact_count>(medium_random)
+        .most_critical(10);
+      auto streamed = most_critical_cells(medium_random, 10, ices::exact_count());
+      TEST_EQUAL("top size", 10, streamed.size());
+      for (size_t i = 0; i < streamed.size(); ++i) {
+        TEST_TRUE("top " + std::to_string(i),
+                  (from_table[i].row == streamed[i].row) &&
+                  (from_table[i].column == streamed[i].column) &&
+                  (from_table[i].paths == streamed[i].paths));
+        if (i > 0) {
+          TEST_FALSE("ordered", streamed[i - 1].paths < streamed[i].paths);
+        }
+      }
+
+      auto maze_top = most_critical_cells(maze, 3, checked);
+      TEST_EQUAL("maze top size", 3, maze_top.size());
+      TEST_TRUE("maze top is on the path",
+                (maze_top[0].row == 0) && (maze_top[0].column == 1) &&
+                (maze_top[0].paths == 1));
+      TEST_TRUE("k = 0", most_critical_cells(maze, 0, checked).empty());
+    });
+
+  rubric.criterion("path generation and sampling", 1, [&]() {
+      ices::path_generator maze_paths(maze);
+      auto only = maze_paths.next();
+      TEST_TRUE("maze path", only.has_value());
+      TEST_TRUE("maze route", *only == ices::path(maze, {
+            ices::STEP_DIRECTION_RIGHT, ices::STEP_DIRECTION_DOWN,
+            ices::STEP_DIRECTION_RIGHT, ices::STEP_DIRECTION_DOWN,
+            ices::STEP_DIRECTION_RIGHT, ices::STEP_DIRECTION_DOWN}));
+      TEST_FALSE("maze done", maze_paths.next().has_value());
+      TEST_FALSE("maze stays done", maze_paths.next().has_value());
+
+      ices::path_generator blocked(all_ices);
+      TEST_FALSE("no paths", blocked.next().has_value());
+
+      ices::path_generator medium_paths(medium_random);
+      unsigned produced = 0;
+      std::optional<ices::path> previous;
+      while (auto route = medium_paths.next()) {
+        TEST_TRUE("reaches goal",
+                  (route->final_row() == medium_random.rows() - 1) &&
+                  (route->final_column() == medium_random.columns() - 1));
+        TEST_FALSE("distinct", previous && (*previous == *route));
+        previous = std::move(route);
+        ++produced;
+      }
+      TEST_EQUAL("every path", iceberg_avoiding_dyn_prog(medium_random), produced);
+
+      ices::path_sampler no_sampler(all_ices);
+      TEST_FALSE("sampler without paths", no_sampler.has_paths());
+
+      ices::grid open3(3, 3);
+      ices::path_sampler sampler(open3);
+      TEST_TRUE("sampler with paths", sampler.has_paths());
+      std::mt19937 sample_gen(23);
+      std::vector<std::vector<ices::step_direction>> routes;
+      std::vector<unsigned> hits;
+      ices::path_generator open3_paths(open3);
+      while (auto route = open3_paths.next()) {
+        routes.emplace_back();
+        for (size_t i = 1; i < route->steps().size(); ++i) {
+          routes.back().push_back(route->steps()[i].direction());
+        }
+        hits.push_back(0);
+      }
+      TEST_EQUAL("open3 paths", 6, routes.size());
+      const unsigned SAMPLES = 6000;
+      for (unsigned i = 0; i < SAMPLES; ++i) {
+        ices::path sampled = sampler.sample(sample_gen);
+        for (size_t k = 0; k < routes.size(); ++k) {
+          if (sampled == ices::path(open3, routes[k])) {
+            ++hits[k];
+          }
+        }
+      }
+      for (size_t k = 0; k < routes.size(); ++k) {
+        TEST_TRUE("uniform " + std::to_string(k), (hits[k] > 850) && (hits[k] < 1150));
+      }
+
+      ices::path_sampler large_sampler(large_random);
+      ices::path sampled = large_sampler.sample(sample_gen);
+      TEST_EQUAL("large sample length",
+                 large_random.rows() + large_random.columns() - 1,
+                 sampled.steps().size());
+    });
+
+  rubric.criterion("compact paths", 1, [&]() {
+      ices::compact_path empty;
+      TEST_EQUAL("empty size", 0, empty.size());
+      TEST_TRUE("empty valid", empty.is_valid_in(maze));
+
+      ices::path maze_route(maze, {
+          ices::STEP_DIRECTION_RIGHT, ices::STEP_DIRECTION_DOWN,
+          ices::STEP_DIRECTION_RIGHT, ices::STEP_DIRECTION_DOWN,
+          ices::STEP_DIRECTION_RIGHT, ices::STEP_DIRECTION_DOWN});
+      ices::compact_path compact(maze_route);
+      TEST_EQUAL("size", 6, compact.size());
+      TEST_EQUAL("words", 1, compact.words().size());
+      TEST_EQUAL("bits", 0x2A, compact.words()[0]);
+      TEST_EQUAL("direction", ices::STEP_DIRECTION_DOWN, compact.direction(1));
+      TEST_TRUE("valid", compact.is_valid_in(maze));
+      TEST_TRUE("round trip", compact.to_path(maze) == maze_route);
+
+      ices::compact_path into_ice;
+      into_ice.add_step(ices::STEP_DIRECTION_DOWN);
+      TEST_FALSE("into ice", into_ice.is_valid_in(maze));
+      ices::compact_path off_grid;
+      for (int i = 0; i < 4; ++i) {
+        off_grid.add_step(ices::STEP_DIRECTION_RIGHT);
+      }
+      TEST_FALSE("off grid", off_grid.is_valid_in(maze));
+
+      // Long runs that cross word boundaries, in both the path and the grid.
+      ices::grid wide(3, 200);
+      ices::compact_path long_route;
+      for (int i = 0; i < 150; ++i) {
+        long_route.add_step(ices::STEP_DIRECTION_RIGHT);
+      }
+      long_route.add_step(ices::STEP_DIRECTION_DOWN);
+      for (int i = 0; i < 49; ++i) {
+        long_route.add_step(ices::STEP_DIRECTION_RIGHT);
+      }
+      long_route.add_step(ices::STEP_DIRECTION_DOWN);
+      TEST_EQUAL("long size", 201, long_route.size());
+      TEST_EQUAL("long words", 4, long_route.words().size());
+      TEST_TRUE("long valid", long_route.is_valid_in(wide));
+      wide.set(2, 150, ices::CELL_ICEBERG);
+      TEST_TRUE("ice off route", long_route.is_valid_in(wide));
+      wide.set(0, 100, ices::CELL_ICEBERG);
+      TEST_FALSE("ice in first run", long_route.is_valid_in(wide));
+      wide.set(0, 100, ices::CELL_WATER);
+      wide.set(1, 190, ices::CELL_ICEBERG);
+      TEST_FALSE("ice in second run", long_route.is_valid_in(wide));
+      wide.set(1, 190, ices::CELL_WATER);
+      wide.set(2, 199, ices::CELL_ICEBERG);
+      TEST_FALSE("ice at end", long_route.is_valid_in(wide));
+
+      ices::path_sampler sampler(large_random);
+      std::mt19937 gen(15);
+      for (int i = 0; i < 20; ++i) {
+        ices::compact_path sampled = sampler.sample_compact(gen);
+        TEST_TRUE("sample valid", sampled.is_valid_in(large_random));
+        TEST_TRUE("sample reaches goal",
+                  (sampled.final_row() == large_random.rows() - 1) &&
+                  (sampled.final_column() == large_random.columns() - 1));
+        TEST_TRUE("sample round trip",
+                  ices::compact_path(sampled.to_path(large_random)) == sampled);
+      }
+    });
+
+  rubric.criterion("cached solver", 1, [&]() {
+      TEST_EQUAL("hash deterministic",
+                 ices::grid_hash(medium_random), ices::grid_hash(ices::grid(medium_random)));
+      TEST_TRUE("hash shape", ices::grid_hash(ices::grid(2, 3)) != ices::grid_hash(ices::grid(3, 2)));
+      ices::grid changed = large_random;
+      changed.set(large_random.rows() - 1, 0,
+                  (large_random.get(large_random.rows() - 1, 0) == ices::CELL_WATER)
+                  ? ices::CELL_ICEBERG : ices::CELL_WATER);
+      TEST_TRUE("hash cells", ices::grid_hash(changed) != ices::grid_hash(large_random));
+      for (ices::simd_level level : {ices::SIMD_SCALAR, ices::SIMD_SSE4, ices::SIMD_AVX2}) {
+        if (ices::simd_level_supported(level)) {
+          for (auto* g : {&maze, &medium_random, &large_random, &changed}) {
+            TEST_EQUAL("hash level " + std::to_string(level),
+                       ices::grid_hash(*g, ices::SIMD_SCALAR),
+                       ices::grid_hash(*g, level));
+          }
+        }
+      }
+
+      ices::cached_solver<ices::wrapping_count> cache(2);
+      TEST_EQUAL("miss", iceberg_avoiding_dyn_prog(maze), cache.solve(maze));
+      TEST_EQUAL("hit", iceberg_avoiding_dyn_prog(maze), cache.solve(maze));
+      TEST_EQUAL("second", iceberg_avoiding_dyn_prog(empty4), cache.solve(empty4));
+      TEST_EQUAL("hits", 1, cache.hits());
+      TEST_EQUAL("misses", 2, cache.misses());
+      TEST_EQUAL("size", 2, cache.size());
+
+      // maze is now the least recently used entry, so it is evicted.
+      TEST_EQUAL("third", iceberg_avoiding_dyn_prog(small_random), cache.solve(small_random));
+      TEST_EQUAL("evictions", 1, cache.evictions());
+      TEST_EQUAL("size bounded", 2, cache.size());
+      cache.solve(empty4);
+      TEST_EQUAL("empty4 kept", 2, cache.hits());
+      cache.solve(maze);
+      TEST_EQUAL("maze evicted", 4, cache.misses());
+
+      const std::string filename = "ices_test_cache.tmp";
+      ices::cached_solver<ices::exact_count> exact(4);
+      ices::grid open_big(40, 40);
+      auto open_count = exact.solve(open_big);
+      exact.solve(maze);
+      TEST_TRUE("save", exact.save(filename));
+      ices::cached_solver<ices::exact_count> warm(4);
+      TEST_TRUE("load", warm.load(filename));
+      TEST_EQUAL("loaded size", 2, warm.size());
+      TEST_EQUAL("loaded count", open_count.to_string(), warm.solve(open_big).to_string());
+      TEST_EQUAL("loaded hit", 1, warm.hits());
+      TEST_EQUAL("loaded misses", 0, warm.misses());
+
+      ices::cached_solver<ices::exact_count> small(1);
+      TEST_TRUE("load into smaller", small.load(filename));
+      TEST_EQUAL("most recent kept", 1, small.size());
+      small.solve(maze);
+      TEST_EQUAL("most recent hit", 1, small.hits());
+
+      // A file saved under another policy or modulus is a miss.
+      ices::cached_solver<ices::checked_count> other_policy(4);
+      TEST_FALSE("other policy", other_policy.load(filename));
+      TEST_EQUAL("other policy empty", 0, other_policy.size());
+      ices::cached_solver<ices::modular_count> modular(4, ices::modular_count(1000003));
+      modular.solve(open_big);
+      TEST_TRUE("save modular", modular.save(filename));
+      ices::cached_solver<ices::modular_count> same_modulus(4, ices::modular_count(1000003)),
+        other_modulus(4, ices::modular_count(998244353));
+      TEST_TRUE("same modulus", same_modulus.load(filename));
+      TEST_FALSE("other modulus", other_modulus.load(filename));
+      TEST_EQUAL("other modulus empty", 0, other_modulus.size());
+      other_modulus.solve(open_big);
+      TEST_EQUAL("other modulus miss", 1, other_modulus.misses());
+
+      std::vector<ices::big_unsigned::limb> limbs{5, 0, 7, 0, 0};
+      ices::big_unsigned from_limbs(limbs);
+      TEST_EQUAL("limbs trimmed", 3, from_limbs.limbs().size());
+      TEST_TRUE("zero limbs", ices::big_unsigned(std::vector<ices::big_unsigned::limb>{0, 0})
+                .is_zero());
+
+      std::remove(filename.c_str());
+      TEST_FALSE("load missing", warm.load(filename));
+    });
+
+  rubric.criterion("solver stats", 1, [&]() {
+      TEST_TRUE("null stats empty", std::is_empty<ices::null_stats>::value);
+
+      // 6 steps with 3 down steps gives 20 candidates.
+      auto exhaustive = iceberg_avoiding_exhaustive_with_stats(maze, ices::wrapping_count());
+      TEST_EQUAL("exhaustive count", 1, exhaustive.count);
+      TEST_EQUAL("exhaustive candidates", 20,
+                 exhaustive.stats.candidates_examined + exhaustive.stats.candidates_pruned);
+      TEST_TRUE("exhaustive pruned", exhaustive.stats.candidates_pruned > 0);
+      TEST_TRUE("exhaustive cells", exhaustive.stats.cells_processed > 0);
+      TEST_TRUE("exhaustive cells reused",
+                exhaustive.stats.cells_processed < 20 * 6);
+      TEST_TRUE("exhaustive timed", exhaustive.stats.phase_seconds[ices::PHASE_SOLVE] >= 0);
+
+      auto open_exhaustive = iceberg_avoiding_exhaustive_with_stats(empty4, ices::wrapping_count());
+      TEST_EQUAL("open exhaustive candidates", 20, open_exhaustive.stats.candidates_examined);
+      TEST_EQUAL("open exhaustive pruned", 0, open_exhaustive.stats.candidates_pruned);
+
+      // Each non-empty prefix is a path to some cell other than (0, 0), so
+      // the open 4x4 grid has 69 - 1 = 68 of them, the sum of its forward
+      // table less the start, and no dead ends.
+      auto backtracking = iceberg_avoiding_backtracking_with_stats(empty4, ices::wrapping_count(), false);
+      TEST_EQUAL("backtracking count", 20, backtracking.count);
+      TEST_EQUAL("backtracking candidates", 68, backtracking.stats.candidates_examined);
+      TEST_EQUAL("backtracking pruned", 0, backtracking.stats.candidates_pruned);
+      // (0, 2) is a dead end.
+      ices::grid dead_end(3, 3);
+      dead_end.set(1, 2, ices::CELL_ICEBERG);
+      auto unpruned = iceberg_avoiding_backtracking_with_stats(dead_end, ices::wrapping_count(), false);
+      auto pruned = iceberg_avoiding_backtracking_with_stats(dead_end, ices::wrapping_count(), true);
+      TEST_EQUAL("same count", unpruned.count, pruned.count);
+      TEST_EQUAL("dead end abandoned", 1, unpruned.stats.candidates_pruned);
+      TEST_EQUAL("no dead ends", 0, pruned.stats.candidates_pruned);
+      TEST_EQUAL("fewer prefixes", unpruned.stats.candidates_examined - 1,
+                 pruned.stats.candidates_examined);
+      TEST_TRUE("pruned copies grid", pruned.stats.bytes_allocated >= 8);
+
+      auto dyn_prog = iceberg_avoiding_dyn_prog_with_stats(large_random, ices::checked_count());
+      TEST_EQUAL("dyn_prog count", iceberg_avoiding_dyn_prog(large_random, ices::checked_count()),
+                 dyn_prog.count);
+      TEST_EQUAL("dyn_prog cells", large_random.rows() * large_random.columns(),
+                 dyn_prog.stats.cells_processed);
+      TEST_EQUAL("dyn_prog bytes", large_random.columns() * sizeof(std::uint64_t),
+                 dyn_prog.stats.bytes_allocated);
+      TEST_EQUAL("dyn_prog candidates", 0, dyn_prog.stats.candidates_examined);
+
+      std::ostringstream printed;
+      printed << dyn_prog.stats;
+      TEST_TRUE("printable", printed.str().find("cells=") != std::string::npos);
+    });
+
+  rubric.criterion("fixed-shape solvers", 1, [&]() {
+      constexpr const char* MAZE_LINES[4] = {"..XX", "X..X", "XX..", "XXX."};
+      constexpr ices::fixed_grid<4, 4> fixed_maze(MAZE_LINES);
+      static_assert(iceberg_avoiding_dyn_prog(fixed_maze) == 1, "maze");
+      static_assert(iceberg_avoiding_exhaustive(fixed_maze) == 1, "maze");
+      static_assert(fixed_maze.get(1, 0) == ices::CELL_ICEBERG, "maze cell");
+      constexpr ices::fixed_grid<8, 8> open8;
+      static_assert(iceberg_avoiding_dyn_prog(open8) == 3432, "open 8x8");
+      static_assert(iceberg_avoiding_exhaustive(open8) == 3432, "open 8x8");
+      static_assert(iceberg_avoiding_dyn_prog(ices::fixed_grid<34, 34>(),
+                                              ices::checked_count())
+                    == 7219428434016265740ULL, "open 34x34");
+      static_assert(iceberg_avoiding_dyn_prog(ices::fixed_grid<35, 35>(),
+                                              ices::modular_count(1000000007))
+                    == 69287808, "open 35x35");
+
+      TEST_TRUE("to_grid", fixed_maze.to_grid() == maze);
+      ices::fixed_grid<4, 4> copied(maze);
+      TEST_TRUE("from grid", copied.to_grid() == maze);
+
+      // The runtime solvers dispatch to the fixed-shape ones for these
+      // shapes; both must agree with the general algorithms.
+      std::mt19937 fixed_gen(19);
+      for (int i = 0; i < 20; ++i) {
+        for (ices::coordinate n : {8, 16, 32}) {
+          ices::grid g = ices::grid::random(n, n, n * n / 4, fixed_gen);
+          auto expected = dyn_prog_rolling(g, ices::checked_count());
+          TEST_EQUAL("dyn_prog dispatch", expected,
+                     iceberg_avoiding_dyn_prog(g, ices::checked_count()));
+          TEST_EQUAL("exact not dispatched", ices::big_unsigned(expected),
+                     iceberg_avoiding_dyn_prog(g, ices::exact_count()));
+        }
+        ices::grid g8 = ices::grid::random(8, 8, 16, fixed_gen);
+        ices::null_stats no_stats;
+        TEST_EQUAL("exhaustive dispatch",
+                   iceberg_avoiding_exhaustive(g8, ices::wrapping_count(), no_stats),
+                   iceberg_avoiding_exhaustive(g8));
+        TEST_EQUAL("fixed exhaustive",
+                   iceberg_avoiding_dyn_prog(g8),
+                   iceberg_avoiding_exhaustive(ices::fixed_grid<8, 8>(g8)));
+      }
+    });
+
+  rubric.criterion("reachability prefilter", 1, [&]() {
+      TEST_FALSE("all ices", ices::path_exists(all_ices));
+      TEST_TRUE("maze", ices::path_exists(maze));
+      TEST_FALSE("all ices live", ices::live_cells(all_ices).has_value());
+      TEST_EQUAL("all ices count", 0, iceberg_avoiding_dyn_prog_live(all_ices));
+      TEST_EQUAL("maze count", maze_solution, iceberg_avoiding_dyn_prog_live(maze));
+
+      // A wall with one gap in the last word.
+      ices::grid wide(3, 200);
+      for (ices::coordinate c = 0; c < 199; ++c) {
+        wide.set(1, c, ices::CELL_ICEBERG);
+      }
+      TEST_TRUE("gap at end", ices::path_exists(wide));
+      TEST_EQUAL("gap at end count", 1, iceberg_avoiding_dyn_prog_live(wide));
+      wide.set(0, 130, ices::CELL_ICEBERG);
+      TEST_FALSE("gap cut off", ices::path_exists(wide));
+      TEST_EQUAL("gap cut off count", 0, iceberg_avoiding_dyn_prog_live(wide));
+
+      // Compare against the full tables: a cell is live exactly when paths
+      // both reach it and leave it for the goal.
+      std::mt19937 reach_gen(20);
+      for (int i = 0; i < 60; ++i) {
+        ices::coordinate rows = 1 + reach_gen() % 12,
+          columns = 1 + reach_gen() % 150;
+        if (rows * columns < 3) {
+          continue;
+        }
+        unsigned icebergs = (rows * columns - 2) * (i % 6) / 10;
+        ices::grid g = ices::grid::random(rows, columns, icebergs, reach_gen);
+        auto forward = iceberg_avoiding_dyn_prog_table(g, ices::checked_count());
+        auto backward = iceberg_avoiding_backward_table(g, ices::checked_count());
+        bool exists = backward.get(0, 0) > 0;
+        TEST_EQUAL("exists", exists, ices::path_exists(g));
+        TEST_EQUAL("count", forward.get(rows - 1, columns - 1),
+                   iceberg_avoiding_dyn_prog_live(g, ices::checked_count()));
+        auto live = ices::live_cells(g);
+        TEST_EQUAL("live exists", exists, live.has_value());
+        if (live) {
+          bool same = true;
+          for (ices::coordinate r = 0; r < rows; ++r) {
+            for (ices::coordinate c = 0; c < columns; ++c) {
+              bool on_path = (forward.get(r, c) > 0) && (backward.get(r, c) > 0);
+              same = same && (on_path == (live->get(r, c) == ices::CELL_WATER));
+            }
+          }
+          TEST_TRUE("live cells", same);
+        }
+      }
+    });
+
+  rubric.criterion("random generators", 1, [&]() {
+      auto count_icebergs = [](const ices::grid& g) {
+        size_t total = 0;
+        for (auto w : g.words()) {
+          total += __builtin_popcountll(w);
+        }
+        return total;
+      };
+
+      for (unsigned k : {0u, 1u, 50u, 498u}) {
+        std::mt19937 a(7), b(7);
+        ices::grid g = ices::grid::random(20, 25, k, a);
+        TEST_EQUAL("exact count", k, count_icebergs(g));
+        TEST_EQUAL("start water", ices::CELL_WATER, g.get(0, 0));
+        TEST_EQUAL("goal water", ices::CELL_WATER, g.get(19, 24));
+        TEST_TRUE("reproducible", g == ices::grid::random(20, 25, k, b));
+      }
+      ices::splitmix64 split_gen(3);
+      ices::grid from_splitmix = ices::grid::random(300, 300, 40000, split_gen);
+      TEST_EQUAL("splitmix exact count", 40000, count_icebergs(from_splitmix));
+      std::minstd_rand minstd_gen(5);
+      ices::grid from_minstd = ices::grid::random(40, 50, 700, minstd_gen);
+      TEST_EQUAL("minstd exact count", 700, count_icebergs(from_minstd));
+      std::default_random_engine default_gen(5);
+      ices::grid from_default = ices::grid::random(40, 50, 700, default_gen);
+      TEST_EQUAL("default engine exact count", 700, count_icebergs(from_default));
+      std::vector<unsigned> high_bits(4, 0);
+      for (int i = 0; i < 4000; ++i) {
+        ++high_bits[ices::random_bits(minstd_gen) >> 62];
+      }
+      for (auto hits : high_bits) {
+        TEST_TRUE("minstd high bits", (hits > 850) && (hits < 1150));
+      }
+
+      std::mt19937 below_gen(11);
+      std::vector<unsigned> buckets(6, 0);
+      for (int i = 0; i < 6000; ++i) {
+        auto value = ices::random_below(below_gen, 6);
+        TEST_TRUE("below bound", value < 6);
+        ++buckets[value];
+      }
+      for (auto hits : buckets) {
+        TEST_TRUE("below uniform", (hits > 850) && (hits < 1150));
+      }
+
+      ices::grid one_thread = ices::random_grid_with_density(1000, 1000, 0.3, 5, 1),
+        four_threads = ices::random_grid_with_density(1000, 1000, 0.3, 5, 4);
+      TEST_TRUE("same for any thread count", one_thread == four_threads);
+      TEST_FALSE("seed matters",
+                 one_thread == ices::random_grid_with_density(1000, 1000, 0.3, 6));
+      size_t icebergs = count_icebergs(one_thread);
+      TEST_TRUE("density", (icebergs > 295000) && (icebergs < 305000));
+      TEST_EQUAL("no icebergs", 0,
+                 count_icebergs(ices::random_grid_with_density(7, 130, 0.0, 1)));
+      ices::grid full = ices::random_grid_with_density(7, 130, 1.0, 1, 3);
+      TEST_EQUAL("all icebergs", 7 * 130 - 2, count_icebergs(full));
+      TEST_EQUAL("full start water", ices::CELL_WATER, full.get(0, 0));
+      TEST_EQUAL("full goal water", ices::CELL_WATER, full.get(6, 129));
+    });
+
+  rubric.criterion("solver context", 1, [&]() {
+      ices::scratch_arena arena;
+      {
+        ices::scratch_arena::scope outer(arena);
+        auto small = arena.allocate<unsigned>(10);
+        auto large = arena.allocate<uint64_t>(1000);
+        small[9] = 1;
+        large[999] = 2;
+        TEST_EQUAL("overflow blocks", 2, arena.heap_allocations());
+      }
+      TEST_EQUAL("consolidated", 3, arena.heap_allocations());
+      TEST_TRUE("capacity", arena.capacity() >= 8040);
+      for (int i = 0; i < 5; ++i) {
+        ices::scratch_arena::scope outer(arena);
+        arena.allocate<unsigned>(10);
+        {
+          ices::scratch_arena::scope inner(arena);
+          arena.allocate<uint64_t>(1000);
+        }
+        arena.allocate<uint64_t>(1000);
+      }
+      TEST_EQUAL("reused", 3, arena.heap_allocations());
+      TEST_EQUAL("released", 0, arena.used());
+
+      std::mt19937 gen(23);
+      std::vector<ices::grid> settings;
+      for (ices::coordinate n : {12, 9, 16, 5}) {
+        settings.push_back(ices::grid::random(n, n + 3, n * n / 5, gen));
+      }
+      ices::solver_context context;
+      for (int round = 0; round < 3; ++round) {
+        size_t before = context.heap_allocations();
+        for (auto& g : settings) {
+          TEST_EQUAL("dyn prog", iceberg_avoiding_dyn_prog(g),
+                     iceberg_avoiding_dyn_prog(g, ices::wrapping_count(), context));
+          // Exhaustive search is exponential, so it only runs on the small
+          // shapes.
+          if ((g.rows() <= 9) && (g.columns() <= 12)) {
+            TEST_EQUAL("exhaustive", iceberg_avoiding_exhaustive(g),
+                       iceberg_avoiding_exhaustive(g, ices::wrapping_count(), context));
+          }
+          for (bool prune : {false, true}) {
+            TEST_EQUAL("backtracking", iceberg_avoiding_backtracking(g, prune),
+                       iceberg_avoiding_backtracking(g, ices::wrapping_count(),
+                                                     prune, context));
+          }
+        }
+        // Everything was sized by the first round.
+        if (round > 0) {
+          TEST_EQUAL("steady state", before, context.heap_allocations());
+        }
+      }
+      ices::grid big(8, 8);
+      TEST_EQUAL("fixed shape", 3432,
+                 iceberg_avoiding_dyn_prog(big, ices::wrapping_count(), context));
+      ices::big_unsigned expected = iceberg_avoiding_dyn_prog(big, ices::exact_count());
+      TEST_TRUE("exact", expected ==
+                iceberg_avoiding_dyn_prog(big, ices::exact_count(), context));
+    });
+
+  rubric.criterion("sparse inclusion-exclusion", 1, [&]() {
+      std::mt19937 gen(29);
+      for (ices::coordinate n : {1, 2, 5, 12, 40, 90}) {
+        for (unsigned density : {0u, 3u, 20u}) {
+          ices::coordinate rows = n, columns = n + 7;
+          ices::grid g = ices::grid::random(rows, columns,
+                                            rows * columns * density / 100 / 2,
+                                            gen);
+          TEST_EQUAL("wrapping", iceberg_avoiding_dyn_prog(g),
+                     iceberg_avoiding_sparse(g));
+          TEST_EQUAL("checked",
+                     iceberg_avoiding_dyn_prog(g, ices::checked_count()),
+                     iceberg_avoiding_sparse(g, ices::checked_count()));
+          for (std::uint64_t modulus : {1000000007ULL, 7ULL, 12ULL,
+                                        (1ULL << 63)}) {
+            ices::modular_count policy(modulus);
+            TEST_EQUAL("modular", iceberg_avoiding_dyn_prog(g, policy),
+                       iceberg_avoiding_sparse(g, policy));
+          }
+          ices::big_unsigned exact = iceberg_avoiding_sparse(g, ices::exact_count());
+          TEST_TRUE("exact",
+                    exact == iceberg_avoiding_dyn_prog(g, ices::exact_count()));
+        }
+      }
+
+      std::vector<ices::cell_position> icebergs = {{3, 4}, {1, 1}, {3, 4}, {0, 2}};
+      ices::grid listed(5, 6);
+      for (auto& p : icebergs) {
+        listed.set(p.row, p.column, ices::CELL_ICEBERG);
+      }
+      TEST_EQUAL("coordinate list", iceberg_avoiding_dyn_prog(listed),
+                 iceberg_avoiding_sparse(5, 6, icebergs, ices::wrapping_count()));
+      TEST_EQUAL("iceberg at goal", 0,
+                 iceberg_avoiding_sparse(5, 6, {{4, 5}}, ices::wrapping_count()));
+      TEST_EQUAL("no icebergs", 184756,
+                 iceberg_avoiding_sparse(11, 11, {}, ices::checked_count()));
+      TEST_TRUE("overflow",
+                ices::checked_count::overflowed(
+                  iceberg_avoiding_sparse(60, 60, {{30, 30}},
+                                          ices::checked_count())));
+
+      ices::grid wide(300, 20000);
+      std::vector<ices::cell_position> scattered;
+      for (int i = 0; i < 200; ++i) {
+        ices::cell_position p{ices::random_below(gen, 300),
+                              ices::random_below(gen, 20000)};
+        if ((p.row != 0) || (p.column != 0)) {
+          wide.set(p.row, p.column, ices::CELL_ICEBERG);
+          scattered.push_back(p);
+        }
+      }
+      ices::modular_count prime(998244353);
+      TEST_EQUAL("wide modular", iceberg_avoiding_dyn_prog(wide, prime),
+                 iceberg_avoiding_sparse(300, 20000, scattered, prime));
+    });
+
+  rubric.criterion("run-length grids", 1, [&]() {
+      ices::rle_grid built(3, 10);
+      built.add_ice_run(0, 2, 3);
+      built.add_ice_run(0, 4, 5);
+      built.add_ice_run(2, 0, 0);
+      built.add_ice_run(2, 9, 9);
+      TEST_EQUAL("merged", 3, built.run_count());
+      TEST_EQUAL("row runs", 1, built.row_run_count(0));
+      TEST_EQUAL("empty row", 0, built.row_run_count(1));
+      TEST_EQUAL("run end", 5, built.row_runs(0)[0].last);
+      TEST_EQUAL("goal iced", 0, iceberg_avoiding_dyn_prog(built));
+      ices::rle_grid round_trip(built.to_grid());
+      TEST_TRUE("round trip", round_trip == built);
+
+      std::mt19937 gen(31);
+      for (ices::coordinate n : {1, 3, 8, 64, 65, 200}) {
+        ices::coordinate rows = n, columns = 2 * n + 1;
+        // Ice fields: a few rectangles of ice on open water.
+        ices::grid g(rows, columns);
+        for (int field = 0; field < 4; ++field) {
+          ices::coordinate r = ices::random_below(gen, rows),
+            c = ices::random_below(gen, columns),
+            height = 1 + ices::random_below(gen, 1 + rows / 4),
+            width = 1 + ices::random_below(gen, 1 + columns / 3);
+          for (ices::coordinate i = r; i < std::min(rows, r + height); ++i) {
+            for (ices::coordinate j = c; j < std::min(columns, c + width); ++j) {
+              if ((i != 0) || (j != 0)) {
+                g.set(i, j, ices::CELL_ICEBERG);
+              }
+            }
+          }
+        }
+        ices::rle_grid rle(g);
+        TEST_TRUE("to_grid", rle.to_grid() == g);
+        TEST_TRUE("printable", rle.printable() == g.printable());
+        bool same = true;
+        for (ices::coordinate i = 0; i < rows; ++i) {
+          for (ices::coordinate j = 0; j < columns; ++j) {
+            same = same && (rle.get(i, j) == g.get(i, j)) &&
+              (rle.may_step(i, j) == g.may_step(i, j)) &&
+              (rle.is_water_run(i, j, std::min(columns - 1, j + 5)) ==
+               g.is_water_run(i, j, std::min(columns - 1, j + 5)));
+          }
+        }
+        TEST_TRUE("read api", same);
+        TEST_FALSE("may_step outside", rle.may_step(rows, 0));
+        TEST_EQUAL("wrapping", iceberg_avoiding_dyn_prog(g),
+                   iceberg_avoiding_dyn_prog(rle));
+        TEST_EQUAL("checked",
+                   iceberg_avoiding_dyn_prog(g, ices::checked_count()),
+                   iceberg_avoiding_dyn_prog(rle, ices::checked_count()));
+        ices::big_unsigned exact = iceberg_avoiding_dyn_prog(rle, ices::exact_count());
+        TEST_TRUE("exact", exact == iceberg_avoiding_dyn_prog(g, ices::exact_count()));
+      }
+
+      ices::grid dense = ices::grid::random(30, 40, 400, gen);
+      TEST_EQUAL("dense", iceberg_avoiding_dyn_prog(dense),
+                 iceberg_avoiding_dyn_prog(ices::rle_grid(dense)));
+    });
+
+  rubric.criterion("segmented scan row kernel", 1, [&]() {
+      std::mt19937 scan_gen(37);
+      for (auto level : {ices::SIMD_SCALAR, ices::SIMD_SSE4, ices::SIMD_AVX2}) {
+        if (!ices::simd_level_supported(level)) {
+          continue;
+        }
+        TEST_EQUAL("maze", maze_solution,
+                   iceberg_avoiding_dyn_prog_scan(maze, level));
+        TEST_EQUAL("large", iceberg_avoiding_dyn_prog(large_random),
+                   iceberg_avoiding_dyn_prog_scan(large_random, level));
+        for (ices::coordinate columns : {1, 3, 4, 7, 8, 9, 63, 64, 65, 200}) {
+          for (unsigned percent : {0u, 10u, 45u, 90u}) {
+            ices::coordinate rows = 1 + columns % 13;
+            unsigned cells = rows * columns;
+            ices::grid setting = ices::grid::random(
+              rows, columns, (cells > 2) ? (cells - 2) * percent / 100 : 0,
+              scan_gen);
+            TEST_EQUAL("random " + std::to_string(columns) + " " +
+                       std::to_string(percent) + "%",
+                       iceberg_avoiding_dyn_prog(setting),
+                       iceberg_avoiding_dyn_prog_scan(setting, level));
+          }
+        }
+        // Wrapping must match too.
+        ices::grid open(300, 300);
+        TEST_EQUAL("wraps", iceberg_avoiding_dyn_prog(open),
+                   iceberg_avoiding_dyn_prog_scan(open, level));
+      }
     });
 
   rubric.criterion("stress test", 2,[&]() {
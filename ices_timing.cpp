@@ -14,6 +14,7 @@
 #include "timer.hpp"
 
 #include "ices_algs.hpp"
+#include "ices_parallel.hpp"
 
 void print_bar() {
   std::cout << std::string(79, '-') << std::endl;
@@ -66,6 +67,31 @@ int main() {
   std::cout << "Dynamic programming" << dyn_prog_output << std::endl;
   std::cout << std::endl << "elapsed time=" << elapsed << " seconds" << std::endl;
 
+  print_bar();
+  const ices::coordinate SCALING_N = 4000;
+  std::cout << "parallel dynamic programming scaling, "
+            << SCALING_N << "x" << SCALING_N << std::endl << std::endl;
+  ices::grid scaling_input = ices::grid::random(SCALING_N, SCALING_N,
+                                                SCALING_N * SCALING_N / 10,
+                                                gen);
+  double one_thread = 0;
+  for (unsigned threads = 1;
+       threads <= ices::resolve_thread_count(0); ++threads) {
+    ices::parallel_options options;
+    options.threads = threads;
+    timer.reset();
+    auto parallel_output = iceberg_avoiding_dyn_prog_parallel(scaling_input,
+                                                              options);
+    elapsed = timer.elapsed();
+    if (threads == 1) {
+      one_thread = elapsed;
+    }
+    std::cout << "threads=" << threads
+              << " output=" << parallel_output
+              << " elapsed time=" << elapsed << " seconds"
+              << " speedup=" << (one_thread / elapsed) << std::endl;
+  }
+
   print_bar();
 
   return 0;
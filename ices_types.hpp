@@ -11,9 +11,11 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <random>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <optional>
@@ -23,28 +25,114 @@ namespace ices {
 // Type for a row or column number.
 using coordinate = size_t;
 
+// Return a uniformly distributed 64-bit value from any uniform random bit
+// generator. Each draw contributes its low floor(log2(max - min + 1)) bits,
+// rejecting the rare draws above that many bits, and draws are shifted in
+// until 64 bits have been gathered. Generators that span all 32 or all 64
+// bits, such as std::mt19937 or std::mt19937_64, never reject, and others,
+// such as std::minstd_rand, take a few more draws.
+template <typename URNG>
+std::uint64_t random_bits(URNG& gen) {
+  using engine = std::decay_t<URNG>;
+  constexpr std::uint64_t span = std::uint64_t(engine::max() - engine::min());
+  static_assert(span > 0, "generator must produce more than one value");
+  constexpr unsigned bits =
+    (span == ~std::uint64_t(0)) ? 64 : 63 - __builtin_clzll(span + 1);
+  if constexpr (bits == 64) {
+    return std::uint64_t(gen() - engine::min());
+  } else {
+    std::uint64_t result = 0;
+    for (unsigned gathered = 0; gathered < 64; ) {
+      std::uint64_t value = std::uint64_t(gen() - engine::min());
+      if ((value >> bits) == 0) {
+        result = (result << bits) | value;
+        gathered += bits;
+      }
+    }
+    return result;
+  }
+}
+
+// Return a uniformly distributed value in [0, bound), which must be
+// positive, using Lemire's multiply-and-reject method. Unlike
+// std::uniform_int_distribution, whose algorithm is left to the standard
+// library, this gives the same values everywhere for the same generator.
+template <typename URNG>
+std::uint64_t random_below(URNG& gen, std::uint64_t bound) {
+  assert(bound > 0);
+  unsigned __int128 product = (unsigned __int128)random_bits(gen) * bound;
+  std::uint64_t low = std::uint64_t(product);
+  if (low < bound) {
+    std::uint64_t threshold = -bound % bound;
+    while (low < threshold) {
+      product = (unsigned __int128)random_bits(gen) * bound;
+      low = std::uint64_t(product);
+    }
+  }
+  return std::uint64_t(product >> 64);
+}
+
 // Type for one element of the map grid.
 enum cell_kind { CELL_WATER, CELL_ICEBERG};
 
 // Type for a rectangular grid representing the map.
+//
+// Cells are stored one bit per cell in a single contiguous, row-major buffer
+// of 64-bit words; a set bit marks CELL_ICEBERG. Each row starts on a word
+// boundary, so row r occupies words_per_row() words beginning at
+// row_words(r), and cell (r, c) is bit (c % 64) of word (c / 64) of that row.
+// Padding bits past the last column are always zero.
 class grid {
+public:
+  // Type for one word of packed cells.
+  using word = std::uint64_t;
+
+  // Number of cells packed into one word.
+  static constexpr coordinate WORD_BITS = 64;
+
+  // Return the number of words needed to hold one row of the given width.
+  static constexpr coordinate words_for_columns(coordinate columns) {
+    return (columns + WORD_BITS - 1) / WORD_BITS;
+  }
+
 private:
-  std::vector<std::vector<cell_kind>> cells_;
+  coordinate rows_, columns_, words_per_row_;
+  std::vector<word> words_;
 
 public:
 
   // Create a grid with the given number of rows and columns, all initialized
   // to hold CELL_WATER.
   grid(coordinate rows, coordinate columns)
-  : cells_(rows, std::vector<cell_kind>(columns, CELL_WATER)) {
+  : rows_(rows),
+    columns_(columns),
+    words_per_row_(words_for_columns(columns)),
+    words_(rows * words_for_columns(columns), 0) {
+
+    assert(rows > 0);
+    assert(columns > 0);
+  }
+
+  // Create a grid with the given number of rows and columns from packed
+  // words in the layout described above, taking ownership of them. words
+  // must hold rows * words_for_columns(columns) words with zero padding
+  // bits, and (0, 0) must be CELL_WATER.
+  grid(coordinate rows, coordinate columns, std::vector<word>&& words)
+  : rows_(rows),
+    columns_(columns),
+    words_per_row_(words_for_columns(columns)),
+    words_(std::move(words)) {
 
     assert(rows > 0);
     assert(columns > 0);
+    assert(words_.size() == rows * words_per_row_);
+    assert(!(words_[0] & 1));
   }
 
   // Accessors.
-   coordinate rows() const { return cells_.size(); }
-   coordinate columns() const { return cells_.front().size(); }
+   coordinate rows() const { return rows_; }
+   coordinate columns() const { return columns_; }
+   coordinate words_per_row() const { return words_per_row_; }
 
   // Test whether the given value is a valid row or column number.
    bool is_row(coordinate row) const { return row < rows(); }
@@ -53,10 +141,24 @@ public:
     return is_row(row) && is_column(column);
   }
 
+  // Return a pointer to the words_per_row() packed words of the given row.
+  // Writing through the non-const overload must keep padding bits zero.
+   const word* row_words(coordinate row) const {
+    assert(is_row(row));
+    return words_.data() + row * words_per_row_;
+  }
+   word* row_words(coordinate row) {
+    assert(is_row(row));
+    return words_.data() + row * words_per_row_;
+  }
+
+  // Return the whole packed buffer, rows() * words_per_row() words long.
+   const std::vector<word>& words() const { return words_; }
+
   // Return the cell at the given row and column.
    cell_kind get(coordinate row, coordinate column) const {
     assert(is_row_column(row, column));
-    return cells_[row][column];
+    return is_iceberg(row, column) ? CELL_ICEBERG : CELL_WATER;
   }
 
   // Set the contents of the cell at the given row and column.
@@ -68,17 +170,54 @@ public:
       assert(kind == CELL_WATER);
     }
 
-    cells_[row][column] = kind;
+    word& w = words_[row * words_per_row_ + column / WORD_BITS];
+    word bit = word(1) << (column % WORD_BITS);
+    if (kind == CELL_ICEBERG) {
+      w |= bit;
+    } else {
+      w &= ~bit;
+    }
+  }
+
+  // Return true if the cells from first to last, inclusive, of the given
+  // row are all CELL_WATER. This tests a word of cells at a time.
+  bool is_water_run(coordinate row, coordinate first, coordinate last) const {
+    assert(is_row(row));
+    assert(first <= last);
+    assert(is_column(last));
+
+    const word* words = row_words(row);
+    coordinate first_word = first / WORD_BITS, last_word = last / WORD_BITS;
+    for (coordinate w = first_word; w <= last_word; ++w) {
+      word mask = ~word(0);
+      if (w == first_word) {
+        mask &= ~word(0) << (first % WORD_BITS);
+      }
+      if (w == last_word) {
+        mask &= ~word(0) >> (WORD_BITS - 1 - last % WORD_BITS);
+      }
+      if (words[w] & mask) {
+        return false;
+      }
+    }
+    return true;
   }
 
   // Return true if it is valid to step into the given row and column.
   // This is the case when those are valid row-column values, and also
   // that cell is not CELL_ICEBERG.
    bool may_step(coordinate row, coordinate column) const {
-    return (is_row_column(row, column) &&
-            (cells_[row][column] != CELL_ICEBERG));
+    return (is_row_column(row, column) && !is_iceberg(row, column));
   }
 
+  // Equality operator; grids are equal when they have the same shape and
+  // the same cells.
+  bool operator==(const grid& o) const {
+    return (rows_ == o.rows_) && (columns_ == o.columns_) &&
+           (words_ == o.words_);
+  }
+  bool operator!=(const grid& o) const { return !(*this == o); }
+
   // Return strings corresponding to lines of text in a human-readable
   // representation of the grid.
   std::vector<std::string> printable() const {
@@ -107,6 +246,13 @@ public:
   // passable cells, thicket cells, and random number generator. 
   // rows and columns must both be positive. The number of thicket cells 
   // must be less than the number of total cells in the grid.
+  //
+  // Thicket cells are never placed at (0, 0) or (n-1, m-1). They are chosen
+  // with Floyd's sampling algorithm, using the grid's own bits as the set of
+  // cells chosen so far, so this takes O(thicket_count) time and no memory
+  // beyond the grid. Random numbers are drawn with random_below rather than
+  // a standard distribution, so a given generator and seed produce the same
+  // grid with every standard library.
   template <typename URNG>
   static grid random(coordinate rows, coordinate columns, 
 		     unsigned thicket_count, URNG&& gen) {
@@ -117,43 +263,35 @@ public:
 
     // The output grid, at this point all cells are earth.
     grid result(rows, columns);
+    if (thicket_count == 0) {
+      return result;
+    }
 
-    // Next we are going to shuffle all the positions that could contain the
-    // thicket and use the shuffled order to place those cells randomly.
-    // This approach makes it easy to prevent the thicket cells from colliding
-    // or being placed at (0, 0) and (n-1, m-1)
-
-    struct position {
-
-      coordinate row, column;
-
-      position(coordinate r, coordinate c)
-      : row(r), column(c) { }
-    };
-
-    // Build a vector of every position except (0, 0) and (n-1, m-1)
-    std::vector<position> positions;
-    for (coordinate row = 0; row < rows; ++row) {
-      for (coordinate column = 0; column < columns; ++column) {
-        if (!(row == 0 && column == 0) && ! (row == rows-1 && column == columns-1)) {
-          positions.emplace_back(row, column);
-        }
+    // Candidate p is the cell p + 1 in row-major order, which leaves out
+    // (0, 0) and (n-1, m-1).
+    const std::uint64_t candidates = std::uint64_t(rows) * columns - 2;
+    assert(thicket_count <= candidates);
+
+    // Floyd: for each j, pick t in [0, j]; if t was already picked, j
+    // cannot have been, so pick j instead.
+    for (std::uint64_t j = candidates - thicket_count; j < candidates; ++j) {
+      std::uint64_t t = random_below(gen, j + 1);
+      if (result.is_iceberg((t + 1) / columns, (t + 1) % columns)) {
+        t = j;
       }
-    }
-    // Shuffle the vector randomly using the provided random number generator.
-    shuffle(positions.begin(), positions.end(), gen);
-
-    // Use the first thicket_count positions to place thicket cells.
-    assert(positions.size() >= thicket_count);
-    for (unsigned i = 0; i < thicket_count; ++i) {
-      auto& p = positions.back();
-      result.set(p.row, p.column, CELL_ICEBERG);
-      positions.pop_back();
+      result.set((t + 1) / columns, (t + 1) % columns, CELL_ICEBERG);
     }
 
     // done
     return result;
   }
+
+private:
+  // Test the packed bit for a cell that is known to be inside the grid.
+  bool is_iceberg(coordinate row, coordinate column) const {
+    return (words_[row * words_per_row_ + column / WORD_BITS] >>
+            (column % WORD_BITS)) & 1;
+  }
 };
 
 // Type for a legal step direction; starting at (0, 0) counts as a step.
@@ -287,11 +425,153 @@ public:
     final_column_ = column_after(dir);
   }
 
+  // Make this an empty path in the given grid, keeping the memory of the
+  // steps so a path can be reused without allocating. Room is reserved for
+  // the longest path in the grid, so the steps never grow during a search.
+  void reset(const grid& setting) {
+    steps_.clear();
+    steps_.reserve(setting.rows() + setting.columns() - 1);
+    initialize(setting);
+  }
+
+  // Remove the last step, which must not be the STEP_DIRECTION_START step.
+  void remove_last_step() {
+
+    assert(steps_.size() > 1);
+
+    // Update final row and column
+    final_row_ -= steps_.back().delta_row();
+    final_column_ -= steps_.back().delta_column();
+
+    steps_.pop_back();
+  }
+
   // Equality operator, for unit testing.
   bool operator==(const path& o) const {
     return std::equal(steps_.begin(), steps_.end(), o.steps_.begin());
   }
 
 };
+
+// A sequence of right and down steps stored one bit per step, for keeping
+// many paths in memory at once.
+//
+// Unlike path, a compact_path is not tied to a grid and is not checked as
+// it grows; use is_valid_in to check it against a grid, and to_path to turn
+// it into a path. The implicit STEP_DIRECTION_START step is not stored, so
+// size() is the number of right and down steps.
+//
+// Step i is bit (i % 64) of word (i / 64), set for STEP_DIRECTION_DOWN and
+// clear for STEP_DIRECTION_RIGHT. Bits past the last step are always zero.
+class compact_path {
+public:
+  // Type for one word of packed steps.
+  using word = std::uint64_t;
+
+  // Number of steps packed into one word.
+  static constexpr size_t WORD_BITS = 64;
+
+private:
+  std::vector<word> words_;
+  size_t size_;
+  coordinate final_row_, final_column_;
+
+public:
+
+  // Create a path with no steps, ending at (0, 0).
+  compact_path()
+  : size_(0), final_row_(0), final_column_(0) { }
+
+  // Create a compact copy of the given path.
+  explicit compact_path(const path& original)
+  : compact_path() {
+    reserve(original.steps().size() - 1);
+    for (size_t i = 1; i < original.steps().size(); ++i) {
+      add_step(original.steps()[i].direction());
+    }
+  }
+
+  // Accessors.
+  size_t size() const { return size_; }
+  coordinate final_row() const { return final_row_; }
+  coordinate final_column() const { return final_column_; }
+  const std::vector<word>& words() const { return words_; }
+
+  // Return the direction of step i, counting from 0 after the start.
+  step_direction direction(size_t i) const {
+    assert(i < size_);
+    return ((words_[i / WORD_BITS] >> (i % WORD_BITS)) & 1)
+           ? STEP_DIRECTION_DOWN : STEP_DIRECTION_RIGHT;
+  }
+
+  // Make room for the given total number of steps.
+  void reserve(size_t steps) {
+    words_.reserve((steps + WORD_BITS - 1) / WORD_BITS);
+  }
+
+  // Add one step, which must be STEP_DIRECTION_RIGHT or STEP_DIRECTION_DOWN.
+  // This takes amortized O(1) time.
+  void add_step(step_direction dir) {
+    assert(dir != STEP_DIRECTION_START);
+
+    if ((size_ % WORD_BITS) == 0) {
+      words_.push_back(0);
+    }
+    if (dir == STEP_DIRECTION_DOWN) {
+      words_.back() |= word(1) << (size_ % WORD_BITS);
+      ++final_row_;
+    } else {
+      ++final_column_;
+    }
+    ++size_;
+  }
+
+  // Return true if, starting at (0, 0) of the given grid, every step stays
+  // inside the grid and off CELL_ICEBERG cells. The path need not end at
+  // the bottom-right cell.
+  //
+  // Down steps are found a word at a time, and each maximal run of right
+  // steps is checked against the grid with grid::is_water_run, so this
+  // takes O(rows + steps / 64 + columns / 64) time rather than O(steps).
+  bool is_valid_in(const grid& setting) const {
+    if ((final_row_ >= setting.rows()) || (final_column_ >= setting.columns())) {
+      return false;
+    }
+    coordinate row = 0, column = 0;
+    size_t done = 0; // steps accounted for so far
+    for (size_t w = 0; w < words_.size(); ++w) {
+      for (word downs = words_[w]; downs != 0; downs &= downs - 1) {
+        size_t i = w * WORD_BITS + __builtin_ctzll(downs);
+        coordinate run_end = column + (i - done);
+        if (!setting.is_water_run(row, column, run_end)) {
+          return false;
+        }
+        ++row;
+        column = run_end;
+        done = i + 1;
+      }
+    }
+    return setting.is_water_run(row, column, column + (size_ - done));
+  }
+
+  // Return this path as a path in the given grid, in which it must be valid
+  // as determined by is_valid_in.
+  path to_path(const grid& setting) const {
+    assert(is_valid_in(setting));
+
+    std::vector<step_direction> directions;
+    directions.reserve(size_);
+    for (size_t i = 0; i < size_; ++i) {
+      directions.push_back(direction(i));
+    }
+    return path(setting, directions);
+  }
+
+  // Equality operators.
+  bool operator==(const compact_path& o) const {
+    return (size_ == o.size_) && (words_ == o.words_);
+  }
+  bool operator!=(const compact_path& o) const { return !(*this == o); }
+};
  
 }